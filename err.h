@@ -9,7 +9,7 @@
  *
  * This message is displayed if the input arguments are invalid.
  */
-#define ERROR_WRONG_ARGS_TEXT "invalid program arguments. Correct usage: filesystem <data>."
+#define ERROR_WRONG_ARGS_TEXT "invalid program arguments. Correct usage: filesystem <data> [--mmap] [--cache=<blocks>] [--dentry-cache=<entries>]."
 
 
 /**
@@ -4,18 +4,39 @@
 #include <stdlib.h>
 
 #include "err.h"
+#include "vfs_layers/logic/dentry_cache.h"
+#include "vfs_layers/meta/block_cache.h"
 #include "vfs_layers/shell/shell_layer.h"
 
 static char *filesystem_name;
 
 int main(const int argc, char *argv[]) {
-    // Expect a single argument: path to VFS container file.
+    // Expect the path to the VFS container file, optionally followed by flags.
     if (argc < 2) {
         error_exit(ERROR_WRONG_ARGS_TEXT, ERROR_ARGS);
     }
 
     filesystem_name = argv[1];
 
+    // Optional flags after the container path
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            fs_set_mount_mode(FS_MOUNT_MMAP);
+        } else if (strncmp(argv[i], "--cache=", 8) == 0) {
+            char* end;
+            const long blocks = strtol(argv[i] + 8, &end, 10);
+            if (*end != '\0' || blocks < 0) error_exit(ERROR_WRONG_ARGS_TEXT, ERROR_ARGS);
+            block_cache_set_capacity((uint32_t)blocks);
+        } else if (strncmp(argv[i], "--dentry-cache=", 15) == 0) {
+            char* end;
+            const long count = strtol(argv[i] + 15, &end, 10);
+            if (*end != '\0' || count < 0) error_exit(ERROR_WRONG_ARGS_TEXT, ERROR_ARGS);
+            dentry_cache_set_capacity((uint32_t)count);
+        } else {
+            error_exit(ERROR_WRONG_ARGS_TEXT, ERROR_ARGS);
+        }
+    }
+
     // Ensure unmount/flush on normal process termination.
     atexit(fs_unmount);
 
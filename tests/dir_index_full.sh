@@ -0,0 +1,52 @@
+#!/bin/sh
+# Converting a full directory to a hashed index on a nearly full image must
+# either finish or leave the directory exactly as it was.
+# usage: dir_index_full.sh <inode_fs binary>
+
+BIN=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+cd "$WORK" || exit 1
+
+fail() {
+    echo "dir_index_full: $1"
+    exit 1
+}
+
+# Free data blocks reported by the first statfs in the file
+free_blocks() {
+    grep -A3 '^Blocks:' "$1" | awk '/Free:/ { print $2; exit }'
+}
+
+printf x > one
+
+# 256 entries fill the first directory block; the next one converts the directory
+{
+    echo "format 10"
+    echo "mkdir d"
+    i=1
+    while [ $i -le 256 ]; do echo "incp one d/f$i"; i=$((i + 1)); done
+    echo "incp one spare"
+    echo "statfs"
+    echo "exit"
+} | "$BIN" img.vfs > setup.out 2>&1
+
+# Leave two free blocks: enough for the new bucket and index block, not for
+# the bucket split that re-adding 256 entries needs
+FREE=$(free_blocks setup.out)
+[ -n "$FREE" ] || fail "no statfs output"
+head -c $(((FREE - 2) * 4096)) /dev/urandom > fill
+
+printf 'incp fill fill\nincp one d/x\nstatfs\nls d\ninfo d\nexit\n' | "$BIN" img.vfs > full.out 2>&1
+[ "$(free_blocks full.out)" = 2 ] || fail "blocks leaked by the failed conversion"
+[ "$(grep -c ' f[0-9]* (inode' full.out)" = 256 ] || fail "entries lost by the failed conversion"
+grep -q ' x (inode' full.out && fail "entry added without room for it"
+grep -q 'd - 0 B - i-node' full.out || fail "directory changed by the failed conversion"
+
+# One more free block lets the conversion finish
+printf 'rm spare\nincp one d/y\nls d\ninfo d\ncat d/f200\nexit\n' | "$BIN" img.vfs > room.out 2>&1
+[ "$(grep -c ' [fy][0-9]* (inode' room.out)" = 257 ] || fail "entries missing after the conversion"
+grep -q 'd - 8192 B - i-node' room.out || fail "directory not indexed"
+grep -q '^vfs> x$' room.out || fail "entry unreadable after the conversion"
+
+echo "dir_index_full: OK"
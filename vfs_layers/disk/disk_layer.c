@@ -1,14 +1,35 @@
-// #define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 700
+#define _FILE_OFFSET_BITS 64
 #include "disk_layer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+/** @brief Bounce buffer of the copy fallback when the kernel cannot copy between two files. */
+#define COPY_BUFFER_SIZE (64u * 1024u)
 
 // In-memory mount state
-static FILE* vfs_file = NULL;                 // Opened VFS container file handle
+static int vfs_fd = -1;                       // Raw descriptor of the VFS container file
 static struct superblock_disk sb;             // Cached superblock contents
 
+// Memory-mapped container state (FS_MOUNT_MMAP)
+static enum fs_mount_mode mount_mode = FS_MOUNT_PIO; // Mode applied by the next fs_mount()
+static uint8_t* map_base = NULL;              // Start of the shared mapping, NULL in pread/pwrite mode
+static size_t map_size = 0;                   // Length of the mapping (container file size)
+static size_t map_page_size = 4096;           // Host page size, queried when mapping (msync works on whole pages)
+static uint8_t* map_dirty = NULL;             // One bit per host page written since last msync
+static bool map_has_dirty = false;            // Fast check: any bit set in map_dirty
+
 // In-memory metadata bitmaps
 static uint8_t* inode_bitmap = NULL;          // Allocation bitmap for inodes
 static uint8_t* block_bitmap = NULL;          // Allocation bitmap for blocks
@@ -17,28 +38,274 @@ static uint8_t* block_bitmap = NULL;          // Allocation bitmap for blocks
 static bool inode_bitmap_dirty = false;       // Inode bitmap has changes not yet flushed
 static bool block_bitmap_dirty = false;       // Block bitmap has changes not yet flushed
 
+static atomic_bool no_copy_file_range = false; // Kernel lacks copy_file_range(): go straight to sendfile()
+
 static bool mounted = false;                  // True if VFS file has been mounted successfully
+static bool mounted_clean = false;            // Superblock was FS_STATE_CLEAN when mounted
+
+// Write-back hooks of upper-layer caches
+static fs_flush_hook flush_hooks[FS_MAX_FLUSH_HOOKS];
+static int flush_hook_count = 0;
+
+// Positional read of exactly size bytes; retries on EINTR and partial transfers.
+// Returns the number of bytes actually read (less than size on EOF or error).
+static size_t pread_full(const int fd, void* buffer, const size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t r = pread(fd, (uint8_t*)buffer + done, size - done, offset);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (r == 0) break; // EOF
+        done += (size_t)r;
+        offset += r;
+    }
+    return done;
+}
+
+// Positional write of exactly size bytes; retries on EINTR and partial transfers.
+// Returns the number of bytes actually written (less than size on error).
+static size_t pwrite_full(const int fd, const void* buffer, const size_t size, off_t offset) {
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t w = pwrite(fd, (const uint8_t*)buffer + done, size - done, offset);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (w == 0) break;
+        done += (size_t)w;
+        offset += w;
+    }
+    return done;
+}
+
+// Record [offset, offset + size) as modified so fs_sync() can msync it
+static void map_mark_dirty(const size_t offset, const size_t size) {
+    if (size == 0) return;
+    const size_t first = offset / map_page_size;
+    const size_t last = (offset + size - 1) / map_page_size;
+    for (size_t p = first; p <= last; p++) {
+        map_dirty[p / 8] |= (uint8_t)(1u << (p % 8));
+    }
+    map_has_dirty = true;
+}
+
+// Read from the container through whichever backend is active.
+// Returns the number of bytes copied (less than size past the end of the container or on error).
+static size_t container_read(void* buffer, const size_t size, const off_t offset) {
+    if (map_base) {
+        if ((size_t)offset >= map_size) return 0;
+        const size_t n = ((size_t)offset + size > map_size) ? map_size - (size_t)offset : size;
+        memcpy(buffer, map_base + offset, n);
+        return n;
+    }
+    return pread_full(vfs_fd, buffer, size, offset);
+}
+
+// Write to the container through whichever backend is active.
+// The mapping cannot grow, so writes past the end of a mapped container are truncated.
+static size_t container_write(const void* buffer, const size_t size, const off_t offset) {
+    if (map_base) {
+        if ((size_t)offset >= map_size) return 0;
+        const size_t n = ((size_t)offset + size > map_size) ? map_size - (size_t)offset : size;
+        memcpy(map_base + offset, buffer, n);
+        map_mark_dirty((size_t)offset, n);
+        return n;
+    }
+    return pwrite_full(vfs_fd, buffer, size, offset);
+}
+
+// Moves size bytes between two descriptors inside the kernel: copy_file_range(), then sendfile().
+// Returns the number of bytes moved; fewer than size when neither works for this pair of files.
+static uint64_t kernel_copy(const int in_fd, off_t in_off, const int out_fd, off_t out_off, const uint64_t size) {
+    uint64_t done = 0;
+#ifdef __linux__
+    while (done < size && !no_copy_file_range) {
+        const ssize_t n = copy_file_range(in_fd, &in_off, out_fd, &out_off, (size_t)(size - done), 0);
+        if (n > 0) {
+            done += (uint64_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == ENOSYS) no_copy_file_range = true;
+        break; // EXDEV, EINVAL, EOPNOTSUPP...: this pair needs another way
+    }
+
+    // sendfile() writes at the output's file position
+    if (done < size && lseek(out_fd, out_off, SEEK_SET) == out_off) {
+        while (done < size) {
+            const ssize_t n = sendfile(out_fd, in_fd, &in_off, (size_t)(size - done));
+            if (n > 0) {
+                done += (uint64_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+    }
+#else
+    (void)in_fd; (void)in_off; (void)out_fd; (void)out_off;
+#endif
+    return done;
+}
+
+// Flush dirty page runs of the mapping back to the container file
+static void map_flush(void) {
+    if (!map_base || !map_has_dirty) return;
+
+    const size_t pages = (map_size + map_page_size - 1) / map_page_size;
+    size_t p = 0;
+    while (p < pages) {
+        if (!(map_dirty[p / 8] & (1u << (p % 8)))) { p++; continue; }
+
+        // Extend to the end of the contiguous dirty run
+        const size_t start = p;
+        while (p < pages && (map_dirty[p / 8] & (1u << (p % 8)))) p++;
+
+        const size_t off = start * map_page_size;
+        size_t len = (p - start) * map_page_size;
+        if (off + len > map_size) len = map_size - off;
+        if (msync(map_base + off, len, MS_SYNC) != 0) {
+            fprintf(stderr, "fs_sync: msync failed (offset=%zu): %s\n", off, strerror(errno));
+        }
+    }
+
+    memset(map_dirty, 0, (pages + 7) / 8);
+    map_has_dirty = false;
+}
+
+// Map the whole container file; on failure the mount silently stays in pread/pwrite mode
+static bool map_container(void) {
+    struct stat st;
+    if (fstat(vfs_fd, &st) != 0 || st.st_size <= 0) return false;
+
+    const long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) return false;
+    map_page_size = (size_t)page;
+
+    const size_t size = (size_t)st.st_size;
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, vfs_fd, 0);
+    if (base == MAP_FAILED) return false;
+
+    const size_t pages = (size + map_page_size - 1) / map_page_size;
+    map_dirty = calloc(1, (pages + 7) / 8);
+    if (!map_dirty) {
+        munmap(base, size);
+        return false;
+    }
+
+    map_base = base;
+    map_size = size;
+    map_has_dirty = false;
+    return true;
+}
+
+// Widen a version 1 superblock into the in-memory (version 2) layout
+static void superblock_from_v1(const struct superblock_disk_v1* v1) {
+    memset(&sb, 0, sizeof(sb));
+    sb.magic = v1->magic;
+    sb.version = v1->version;
+    sb.block_size = v1->block_size;
+    sb.inode_bitmap_offset = v1->inode_bitmap_offset;
+    sb.inode_bitmap_size = v1->inode_bitmap_size;
+    sb.block_bitmap_offset = v1->block_bitmap_offset;
+    sb.block_bitmap_size = v1->block_bitmap_size;
+    sb.inode_table_offset = v1->inode_table_offset;
+    sb.total_inodes = v1->total_inodes;
+    sb.data_blocks_offset = v1->data_blocks_offset;
+    sb.total_blocks = v1->total_blocks;
+}
+
+// Narrow the in-memory superblock back to the version 1 layout (values always fit: they came from v1)
+static void superblock_to_v1(struct superblock_disk_v1* v1) {
+    v1->magic = sb.magic;
+    v1->version = sb.version;
+    v1->block_size = sb.block_size;
+    v1->inode_bitmap_offset = (uint32_t)sb.inode_bitmap_offset;
+    v1->inode_bitmap_size = (uint32_t)sb.inode_bitmap_size;
+    v1->block_bitmap_offset = (uint32_t)sb.block_bitmap_offset;
+    v1->block_bitmap_size = (uint32_t)sb.block_bitmap_size;
+    v1->inode_table_offset = (uint32_t)sb.inode_table_offset;
+    v1->total_inodes = (uint32_t)sb.total_inodes;
+    v1->data_blocks_offset = (uint32_t)sb.data_blocks_offset;
+    v1->total_blocks = (uint32_t)sb.total_blocks;
+}
 
 // Read superblock from offset 0
 static bool read_superblock(void) {
     // Read fixed-size superblock at the beginning of the VFS container file
-    if (!vfs_file) return false;
-    if (fseek(vfs_file, 0, SEEK_SET) != 0) return false;
-    return fread(&sb, 1, sizeof(sb), vfs_file) == sizeof(sb);
+    if (vfs_fd < 0) return false;
+
+    // magic + version are common to every format and select the layout
+    uint32_t header[2];
+    if (container_read(header, sizeof(header), 0) != sizeof(header)) return false;
+
+    if (header[1] == FS_VERSION_1) {
+        struct superblock_disk_v1 v1;
+        if (container_read(&v1, sizeof(v1), 0) != sizeof(v1)) return false;
+        superblock_from_v1(&v1);
+        return true;
+    }
+    return container_read(&sb, sizeof(sb), 0) == sizeof(sb);
 }
 
 // Write superblock to offset 0
 static bool write_superblock(void) {
-    // Persist superblock back to disk (container file)
-    if (!vfs_file) return false;
-    if (fseek(vfs_file, 0, SEEK_SET) != 0) return false;
-    const bool ok = fwrite(&sb, 1, sizeof(sb), vfs_file) == sizeof(sb);
-    fflush(vfs_file);
-    return ok;
+    // Persist superblock back to disk (container file), keeping its on-disk version
+    if (vfs_fd < 0) return false;
+
+    if (sb.version == FS_VERSION_1) {
+        struct superblock_disk_v1 v1;
+        superblock_to_v1(&v1);
+        return container_write(&v1, sizeof(v1), 0) == sizeof(v1);
+    }
+    return container_write(&sb, sizeof(sb), 0) == sizeof(sb);
+}
+
+// Unmap and close the container descriptor (used on mount failure and unmount)
+static void close_container(void) {
+    if (map_base) {
+        munmap(map_base, map_size);
+        map_base = NULL;
+        map_size = 0;
+    }
+    if (map_dirty) { free(map_dirty); map_dirty = NULL; }
+    map_has_dirty = false;
+
+    if (vfs_fd >= 0) {
+        close(vfs_fd);
+        vfs_fd = -1;
+    }
+}
+
+// Run every registered flush hook in registration order
+static void run_flush_hooks(const bool unmounting) {
+    for (int i = 0; i < flush_hook_count; i++) {
+        flush_hooks[i](unmounting);
+    }
 }
 
 /* Public API implementations */
 
+bool fs_register_flush_hook(const fs_flush_hook hook) {
+    for (int i = 0; i < flush_hook_count; i++) {
+        if (flush_hooks[i] == hook) return true;
+    }
+    if (flush_hook_count >= FS_MAX_FLUSH_HOOKS) return false;
+    flush_hooks[flush_hook_count++] = hook;
+    return true;
+}
+
+void fs_set_mount_mode(const enum fs_mount_mode mode) {
+    mount_mode = mode;
+}
+
+bool disk_is_mapped(void) {
+    return map_base != NULL;
+}
+
 /* ---------------- Dirty flag API ---------------- */
 
 void fs_mark_inode_bitmap_dirty(void) {
@@ -49,29 +316,72 @@ void fs_mark_block_bitmap_dirty(void) {
     block_bitmap_dirty = true;
 }
 
+void fs_set_free_counts(const uint64_t free_inodes, const uint64_t free_blocks) {
+    sb.free_inodes = free_inodes;
+    sb.free_blocks = free_blocks;
+}
+
+bool fs_write_block_bitmap_bit(const uint64_t block_id) {
+    if (!block_bitmap || block_id / 8 >= sb.block_bitmap_size) return false;
+
+    const uint8_t bit = (uint8_t)(1u << (block_id % 8));
+    if (!(block_bitmap[block_id / 8] & bit)) return true;
+
+    // Read-modify-write of the byte on disk, leaving its other bits as they are there
+    const off_t offset = (off_t)(sb.block_bitmap_offset + block_id / 8);
+    uint8_t on_disk;
+    if (container_read(&on_disk, 1, offset) != 1) return false;
+    if (on_disk & bit) return true;
+    on_disk |= bit;
+    return container_write(&on_disk, 1, offset) == 1;
+}
+
+bool fs_mount_was_clean(void) {
+    return mounted_clean;
+}
+
+void fs_set_alloc_hints(const uint64_t next_inode, const uint64_t next_block) {
+    sb.next_free_inode = next_inode;
+    sb.next_free_block = next_block;
+}
+
 
 bool fs_mount(const char* filename) {
     // Open an existing container file and load superblock + bitmaps into memory
     if (mounted) return true;
 
-    vfs_file = fopen(filename, "r+b");
-    if (!vfs_file) {
+    vfs_fd = open(filename, O_RDWR);
+    if (vfs_fd < 0) {
         fprintf(stderr, "fs_mount: cannot open '%s': %s\n", filename, strerror(errno));
         return false;
     }
 
+    if (mount_mode == FS_MOUNT_MMAP && !map_container()) {
+        fprintf(stderr, "fs_mount: mmap failed, falling back to pread/pwrite\n");
+    }
+
     if (!read_superblock()) {
         fprintf(stderr, "fs_mount: failed to read superblock\n");
-        fclose(vfs_file);
-        vfs_file = NULL;
+        close_container();
         return false;
     }
 
     // Validate filesystem signature before reading any other metadata
     if (sb.magic != FS_MAGIC) {
         fprintf(stderr, "fs_mount: invalid magic (0x%08x)\n", sb.magic);
-        fclose(vfs_file);
-        vfs_file = NULL;
+        close_container();
+        return false;
+    }
+
+    if (sb.version != FS_VERSION_1 && sb.version != FS_VERSION_2) {
+        fprintf(stderr, "fs_mount: unsupported format version %u\n", sb.version);
+        close_container();
+        return false;
+    }
+
+    if (sb.features & ~FS_FEATURES_SUPPORTED) {
+        fprintf(stderr, "fs_mount: unsupported features 0x%08x\n", sb.features & ~FS_FEATURES_SUPPORTED);
+        close_container();
         return false;
     }
 
@@ -80,16 +390,13 @@ bool fs_mount(const char* filename) {
         inode_bitmap = malloc(sb.inode_bitmap_size);
         if (!inode_bitmap) {
             fprintf(stderr, "fs_mount: malloc inode_bitmap failed\n");
-            fclose(vfs_file);
-            vfs_file = NULL;
+            close_container();
             return false;
         }
-        if (fseek(vfs_file, (long)sb.inode_bitmap_offset, SEEK_SET) != 0 ||
-            fread(inode_bitmap, 1, sb.inode_bitmap_size, vfs_file) != sb.inode_bitmap_size) {
+        if (container_read(inode_bitmap, sb.inode_bitmap_size, (off_t)sb.inode_bitmap_offset) != sb.inode_bitmap_size) {
             fprintf(stderr, "fs_mount: failed to read inode bitmap\n");
             free(inode_bitmap); inode_bitmap = NULL;
-            fclose(vfs_file);
-            vfs_file = NULL;
+            close_container();
             return false;
         }
     }
@@ -100,117 +407,193 @@ bool fs_mount(const char* filename) {
         if (!block_bitmap) {
             fprintf(stderr, "fs_mount: malloc block_bitmap failed\n");
             if (inode_bitmap) { free(inode_bitmap); inode_bitmap = NULL; }
-            fclose(vfs_file);
-            vfs_file = NULL;
+            close_container();
             return false;
         }
-        if (fseek(vfs_file, (long)sb.block_bitmap_offset, SEEK_SET) != 0 ||
-            fread(block_bitmap, 1, sb.block_bitmap_size, vfs_file) != sb.block_bitmap_size) {
+        if (container_read(block_bitmap, sb.block_bitmap_size, (off_t)sb.block_bitmap_offset) != sb.block_bitmap_size) {
             fprintf(stderr, "fs_mount: failed to read block bitmap\n");
             free(block_bitmap); block_bitmap = NULL;
             if (inode_bitmap) { free(inode_bitmap); inode_bitmap = NULL; }
-            fclose(vfs_file);
-            vfs_file = NULL;
+            close_container();
             return false;
         }
     }
 
+    // Flag the image as in use until a clean unmount says otherwise
+    mounted_clean = sb.version != FS_VERSION_1 && sb.state == FS_STATE_CLEAN;
+    if (sb.version != FS_VERSION_1) {
+        sb.state = FS_STATE_DIRTY;
+        if (!write_superblock()) {
+            fprintf(stderr, "fs_mount: failed to mark superblock in use\n");
+        }
+        map_flush();
+    }
+
     inode_bitmap_dirty = false;
     block_bitmap_dirty = false;
     mounted = true;
     return true;
 }
 
-void fs_sync() {
-    // Flush dirty metadata to disk: superblock and (if modified) bitmaps
-    if (!mounted || !vfs_file) return;
+// Write back caches, bitmaps and finally the superblock; mark_clean is used by unmount
+static void sync_metadata(const bool mark_clean) {
+    // Upper-layer caches first, so their data lands before the metadata
+    run_flush_hooks(false);
 
-    if (!write_superblock()) {
-        fprintf(stderr, "fs_sync: failed to write superblock\n");
-    }
+    bool ok = true;
 
     if (inode_bitmap && sb.inode_bitmap_size > 0 && inode_bitmap_dirty) {
-        if (fseek(vfs_file, (long)sb.inode_bitmap_offset, SEEK_SET) == 0) {
-            if (fwrite(inode_bitmap, 1, sb.inode_bitmap_size, vfs_file) != sb.inode_bitmap_size) {
-                fprintf(stderr, "fs_sync: failed to write inode bitmap\n");
-            } else {
-                inode_bitmap_dirty = false;
-            }
+        if (container_write(inode_bitmap, sb.inode_bitmap_size, (off_t)sb.inode_bitmap_offset) != sb.inode_bitmap_size) {
+            fprintf(stderr, "fs_sync: failed to write inode bitmap\n");
+            ok = false;
         } else {
-            fprintf(stderr, "fs_sync: fseek inode_bitmap_offset failed\n");
+            inode_bitmap_dirty = false;
         }
     }
 
     if (block_bitmap && sb.block_bitmap_size > 0 && block_bitmap_dirty) {
-        if (fseek(vfs_file, (long)sb.block_bitmap_offset, SEEK_SET) == 0) {
-            if (fwrite(block_bitmap, 1, sb.block_bitmap_size, vfs_file) != sb.block_bitmap_size) {
-                fprintf(stderr, "fs_sync: failed to write block bitmap\n");
-            } else {
-                block_bitmap_dirty = false;
-            }
+        if (container_write(block_bitmap, sb.block_bitmap_size, (off_t)sb.block_bitmap_offset) != sb.block_bitmap_size) {
+            fprintf(stderr, "fs_sync: failed to write block bitmap\n");
+            ok = false;
         } else {
-            fprintf(stderr, "fs_sync: fseek block_bitmap_offset failed\n");
+            block_bitmap_dirty = false;
         }
     }
 
-    fflush(vfs_file);
+    // Superblock last: a clean state must never describe bitmaps that did not reach the file
+    sb.state = (mark_clean && ok) ? FS_STATE_CLEAN : FS_STATE_DIRTY;
+    if (!write_superblock()) {
+        fprintf(stderr, "fs_sync: failed to write superblock\n");
+    }
+
+    // In mapped mode all writes above only touched memory; push dirty pages to the file
+    map_flush();
+}
+
+void fs_sync() {
+    // Flush dirty metadata to disk: bitmaps (if modified) and superblock
+    if (!mounted || vfs_fd < 0) return;
+    sync_metadata(false);
 }
 
 void fs_unmount() {
     // Flush metadata and release all resources
     if (!mounted) return;
 
-    fs_sync();
+    if (vfs_fd >= 0) sync_metadata(true);
+    run_flush_hooks(true);
 
     if (inode_bitmap) { free(inode_bitmap); inode_bitmap = NULL; }
     if (block_bitmap) { free(block_bitmap); block_bitmap = NULL; }
-    if (vfs_file) { fclose(vfs_file); vfs_file = NULL; }
+    close_container();
 
     inode_bitmap_dirty = false;
     block_bitmap_dirty = false;
+    mounted_clean = false;
     mounted = false;
 }
 
-void disk_read(void* buffer, const uint32_t offset, uint32_t size) {
+bool disk_read(void* buffer, const uint64_t offset, const uint32_t size) {
     // Low-level byte-granular read from the container file
-    if (!mounted || !vfs_file) {
+    if (!mounted || vfs_fd < 0) {
         fprintf(stderr, "disk_read: filesystem not mounted\n");
         memset(buffer, 0, size);
-        return;
-    }
-
-    if (fseek(vfs_file, (long)offset, SEEK_SET) != 0) {
-        fprintf(stderr, "disk_read: fseek failed (offset=%u)\n", offset);
-        memset(buffer, 0, size);
-        return;
+        return false;
     }
 
-    const size_t r = fread(buffer, 1, size, vfs_file);
-
-    // If fewer bytes were read, zero-fill the remainder of the destination buffer
+    const size_t r = container_read(buffer, size, (off_t)offset);
     if (r < size) {
-        memset((uint8_t*)buffer + r, 0, size - (uint32_t)r);
+        // Never hand back stale bytes, but make the failure visible to the caller
+        fprintf(stderr, "disk_read: short read at offset %llu (read %zu of %u)\n", (unsigned long long)offset, r, size);
+        memset((uint8_t*)buffer + r, 0, size - r);
+        return false;
     }
+    return true;
 }
 
-void disk_write(const void* buffer, const uint32_t offset, const uint32_t size) {
+bool disk_write(const void* buffer, const uint64_t offset, const uint32_t size) {
     // Low-level byte-granular write to the container file
-    if (!mounted || !vfs_file) {
+    if (!mounted || vfs_fd < 0) {
         fprintf(stderr, "disk_write: filesystem not mounted\n");
-        return;
+        return false;
     }
 
-    if (fseek(vfs_file, (long)offset, SEEK_SET) != 0) {
-        fprintf(stderr, "disk_write: fseek failed (offset=%u)\n", offset);
-        return;
+    const size_t w = container_write(buffer, size, (off_t)offset);
+    if (w < size) {
+        fprintf(stderr, "disk_write: short write at offset %llu (wrote %zu of %u)\n", (unsigned long long)offset, w, size);
+        return false;
     }
+    return true;
+}
 
-    const size_t w = fwrite(buffer, 1, size, vfs_file);
-    if (w != (size_t)size) {
-        fprintf(stderr, "disk_write: short write (wrote %zu of %u)\n", w, size);
+bool disk_copy_to_fd(const int fd, const uint64_t fd_offset, const uint64_t offset, const uint64_t size) {
+    if (!mounted || vfs_fd < 0) {
+        fprintf(stderr, "disk_copy_to_fd: filesystem not mounted\n");
+        return false;
     }
 
-    fflush(vfs_file);
+    // Mapped writes land in the page cache the kernel copies from, so no msync is needed first
+    uint64_t done = kernel_copy(vfs_fd, (off_t)offset, fd, (off_t)fd_offset, size);
+    if (done == size) return true;
+
+    // Fallback: through a bounce buffer (or straight from the mapping)
+    uint8_t* buffer = map_base ? NULL : malloc(COPY_BUFFER_SIZE);
+    while (done < size && (map_base || buffer)) {
+        const size_t want = (size - done < COPY_BUFFER_SIZE) ? (size_t)(size - done) : COPY_BUFFER_SIZE;
+        const off_t at = (off_t)(offset + done);
+        const uint8_t* src = buffer;
+        if (map_base) {
+            if ((uint64_t)at + want > map_size) break;
+            src = map_base + at;
+        } else if (pread_full(vfs_fd, buffer, want, at) != want) {
+            break;
+        }
+        if (pwrite_full(fd, src, want, (off_t)(fd_offset + done)) != want) break;
+        done += want;
+    }
+    free(buffer);
+
+    if (done < size) {
+        fprintf(stderr, "disk_copy_to_fd: short copy at offset %llu (%llu of %llu bytes)\n",
+                (unsigned long long)offset, (unsigned long long)done, (unsigned long long)size);
+        return false;
+    }
+    return true;
+}
+
+bool disk_copy_from_fd(const int fd, const uint64_t fd_offset, const uint64_t offset, const uint64_t size) {
+    if (!mounted || vfs_fd < 0) {
+        fprintf(stderr, "disk_copy_from_fd: filesystem not mounted\n");
+        return false;
+    }
+
+    // Kernel writes go to the page cache the mapping shares; the kernel writes them back itself
+    uint64_t done = (!map_base || offset + size <= map_size) ? kernel_copy(fd, (off_t)fd_offset, vfs_fd, (off_t)offset, size) : 0;
+    if (done == size) return true;
+
+    // Fallback: through a bounce buffer, container side through the active backend
+    uint8_t* buffer = malloc(COPY_BUFFER_SIZE);
+    while (done < size && buffer) {
+        const size_t want = (size - done < COPY_BUFFER_SIZE) ? (size_t)(size - done) : COPY_BUFFER_SIZE;
+        if (pread_full(fd, buffer, want, (off_t)(fd_offset + done)) != want) break;
+        if (container_write(buffer, want, (off_t)(offset + done)) != want) break;
+        done += want;
+    }
+    free(buffer);
+
+    if (done < size) {
+        fprintf(stderr, "disk_copy_from_fd: short copy at offset %llu (%llu of %llu bytes)\n",
+                (unsigned long long)offset, (unsigned long long)done, (unsigned long long)size);
+        return false;
+    }
+    return true;
+}
+
+const void* disk_peek(const uint64_t offset, const uint32_t size) {
+    // Direct pointer into the mapping; only meaningful in FS_MOUNT_MMAP mode
+    if (!mounted || !map_base) return NULL;
+    if (offset + size > map_size) return NULL;
+    return map_base + offset;
 }
 
 /* Accessors */
@@ -225,6 +608,6 @@ bool is_mounted(void) {
 
 uint8_t* fs_get_inode_bitmap() { return inode_bitmap; }
 uint8_t* fs_get_block_bitmap() { return block_bitmap; }
-uint32_t fs_get_inode_bitmap_size() { return sb.inode_bitmap_size; }
-uint32_t fs_get_block_bitmap_size() { return sb.block_bitmap_size; }
+uint64_t fs_get_inode_bitmap_size() { return sb.inode_bitmap_size; }
+uint64_t fs_get_block_bitmap_size() { return sb.block_bitmap_size; }
 
@@ -12,17 +12,63 @@
 #define FS_MAGIC 0xEF53F00D
 
 /**
- * @brief On-disk superblock (filesystem "passport").
+ * @brief Original on-disk format: 32-bit offsets and counts.
  *
- * This structure is stored at offset 0 in the VFS file and describes
- * all layout offsets and sizes.
+ * Still mounted read/write; its superblock is converted to the in-memory
+ * (version 2) layout on mount and back on sync.
+ */
+#define FS_VERSION_1 1
+
+/**
+ * @brief On-disk format with 64-bit offsets and counts (containers > 4 GiB).
+ */
+#define FS_VERSION_2 2
+
+/**
+ * @brief Filesystem format version written by fs_format().
+ */
+#define FS_VERSION FS_VERSION_2
+
+/**
+ * @brief Superblock state: mounted, or not unmounted cleanly; cached counters are stale.
+ */
+#define FS_STATE_DIRTY 0
+
+/**
+ * @brief Superblock state: cleanly unmounted; free counters in the superblock are exact.
+ */
+#define FS_STATE_CLEAN 1
+
+/**
+ * @brief Feature flag: the inode table holds extent-mapped INODE_SIZE-byte inodes.
+ *
+ * Images without it keep the original packed inodes with direct/indirect
+ * block pointers.
+ */
+#define FS_FEATURE_EXTENTS 0x00000001u
+
+/**
+ * @brief Feature flags this implementation understands; mounting fails on any other bit.
+ */
+#define FS_FEATURES_SUPPORTED (FS_FEATURE_EXTENTS)
+
+/**
+ * @brief Size of the version 2 on-disk superblock in bytes.
+ */
+#define FS_SUPERBLOCK_SIZE 256
+
+/**
+ * @brief Version 1 on-disk superblock.
+ *
+ * Stored at offset 0 of images created with FS_VERSION_1. Every offset and
+ * count is 32-bit, which caps the container at 4 GiB.
  *
  * Note: Packed to ensure fixed-size on-disk representation.
  */
-struct superblock_disk {
+struct superblock_disk_v1 {
     /** @brief Magic number identifying the filesystem format. */
     uint32_t magic;
-    /** @brief Filesystem format version. */
+    /** @brief Filesystem format version (FS_VERSION_1). */
     uint32_t version;
     /** @brief Block size in bytes used for data blocks. */
     uint32_t block_size;
@@ -48,9 +94,116 @@ struct superblock_disk {
     uint32_t total_blocks;
 } __attribute__((packed));
 
+/**
+ * @brief On-disk superblock (filesystem "passport"), version 2.
+ *
+ * This structure is stored at offset 0 in the VFS file and describes
+ * all layout offsets and sizes. It is also the in-memory representation
+ * for every mounted version (version 1 images are widened on mount).
+ *
+ * Note: Packed to ensure fixed-size on-disk representation; the reserved
+ * tail keeps it at FS_SUPERBLOCK_SIZE bytes and must be zero.
+ */
+struct superblock_disk {
+    /** @brief Magic number identifying the filesystem format. */
+    uint32_t magic;
+    /** @brief Filesystem format version. */
+    uint32_t version;
+    /** @brief Block size in bytes used for data blocks. */
+    uint32_t block_size;
+    /** @brief FS_STATE_CLEAN after a clean unmount, FS_STATE_DIRTY while mounted or after a crash. */
+    uint32_t state;
+
+    /** @brief Byte offset of inode bitmap in the VFS file. */
+    uint64_t inode_bitmap_offset;
+    /** @brief Size of inode bitmap in bytes. */
+    uint64_t inode_bitmap_size;
+
+    /** @brief Byte offset of data-block bitmap in the VFS file. */
+    uint64_t block_bitmap_offset;
+    /** @brief Size of data-block bitmap in bytes. */
+    uint64_t block_bitmap_size;
+
+    /** @brief Byte offset of inode table in the VFS file. */
+    uint64_t inode_table_offset;
+    /** @brief Total number of inodes in the filesystem. */
+    uint64_t total_inodes;
+
+    /** @brief Byte offset of the first data block in the VFS file. */
+    uint64_t data_blocks_offset;
+    /** @brief Total number of data blocks in the filesystem. */
+    uint64_t total_blocks;
+
+    /** @brief Next-fit allocation cursor: inode id where the next inode search starts. */
+    uint64_t next_free_inode;
+    /** @brief Next-fit allocation cursor: block id where the next block search starts. */
+    uint64_t next_free_block;
+
+    /** @brief Free inode count at the last sync; trusted on mount only if state is FS_STATE_CLEAN. */
+    uint64_t free_inodes;
+    /** @brief Free block count at the last sync; trusted on mount only if state is FS_STATE_CLEAN. */
+    uint64_t free_blocks;
+
+    /** @brief FS_FEATURE_* flags describing optional on-disk structures (0 on version 1). */
+    uint32_t features;
+
+    /** @brief Reserved for future fields, must be zero. */
+    uint8_t reserved[140];
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct superblock_disk) == FS_SUPERBLOCK_SIZE, "superblock_disk must stay FS_SUPERBLOCK_SIZE bytes");
+
+/**
+ * @brief I/O backend used to access the mounted container file.
+ */
+enum fs_mount_mode {
+    /** @brief Positional pread/pwrite on the container descriptor (default). */
+    FS_MOUNT_PIO = 0,
+    /** @brief Whole container mapped with mmap; disk I/O becomes memory copies. */
+    FS_MOUNT_MMAP = 1
+};
+
+/**
+ * @brief Callback used by upper layers to write back their own caches.
+ *
+ * @param unmounting false when called from fs_sync(), true when called from
+ *        fs_unmount() after the final sync (cached state must be dropped).
+ */
+typedef void (*fs_flush_hook)(bool unmounting);
+
+/**
+ * @brief Maximum number of registered flush hooks.
+ */
+#define FS_MAX_FLUSH_HOOKS 8
+
+/**
+ * @brief Registers a hook run at the start of fs_sync() and during fs_unmount().
+ *
+ * Registering the same hook twice has no effect, so it is safe to call this
+ * on every mount.
+ *
+ * @param hook Callback to register.
+ * @return true if registered (or already present), false if the hook table is full.
+ */
+bool fs_register_flush_hook(fs_flush_hook hook);
+
+/**
+ * @brief Selects the I/O backend used by subsequent fs_mount() calls.
+ *
+ * If mapping fails at mount time (e.g. not enough address space), the mount
+ * falls back to FS_MOUNT_PIO.
+ *
+ * @param mode Backend to use.
+ */
+void fs_set_mount_mode(enum fs_mount_mode mode);
+
 /**
  * @brief Mounts an existing VFS file and loads superblock + bitmaps into memory.
  *
+ * A version 2 superblock is immediately rewritten as FS_STATE_DIRTY, so a
+ * crash before fs_unmount() forces a recount on the next mount.
+ * Uses the backend selected by fs_set_mount_mode().
+ *
  * @param filename Path to an existing VFS container file.
  * @return true if mounted successfully, false otherwise.
  */
@@ -59,6 +212,8 @@ bool fs_mount(const char* filename);
 /**
  * @brief Flushes dirty metadata (superblock + bitmaps) to the VFS file.
  *
+ * Registered flush hooks run first so upper-layer caches reach the container
+ * before the metadata describing them. In mapped mode this also msyncs every page range written since the last sync.
  * Safe to call multiple times; does nothing if not mounted.
  */
 void fs_sync(void);
@@ -66,6 +221,9 @@ void fs_sync(void);
 /**
  * @brief Unmounts the filesystem, flushing metadata and releasing memory.
  *
+ * The superblock is written last with FS_STATE_CLEAN if every metadata
+ * write succeeded, so the next mount can trust its free counters.
+ *
  * Safe to call multiple times.
  */
 void fs_unmount(void);
@@ -73,20 +231,110 @@ void fs_unmount(void);
 /**
  * @brief Low-level read from the VFS file by byte offset.
  *
+ * Uses a positional read on the container descriptor, so no shared file
+ * position is involved. On a short read the missing tail is zero-filled.
+ *
  * @param buffer Output buffer.
  * @param offset Byte offset in the VFS container file.
  * @param size Number of bytes to read.
+ * @return true if all bytes were read, false on error or short read.
  */
-void disk_read(void* buffer, uint32_t offset, uint32_t size);
+bool disk_read(void* buffer, uint64_t offset, uint32_t size);
 
 /**
  * @brief Low-level write to the VFS file by byte offset.
  *
+ * Uses a positional write on the container descriptor (no seek, no stdio
+ * buffering). Data reaches the kernel when the call returns.
+ *
  * @param buffer Input buffer.
  * @param offset Byte offset in the VFS container file.
  * @param size Number of bytes to write.
+ * @return true if all bytes were written, false on error or short write.
+ */
+bool disk_write(const void* buffer, uint64_t offset, uint32_t size);
+
+/**
+ * @brief Copies container bytes to a host file descriptor without staging them in user space.
+ *
+ * Uses copy_file_range(), then sendfile(); when the kernel or the file
+ * systems support neither for this pair of files, the bytes go through a
+ * small bounce buffer instead. The container is read as it is on disk:
+ * callers write back cached copies of the range first. Several threads
+ * may copy at once.
+ *
+ * @param fd Host descriptor opened for writing.
+ * @param fd_offset Byte offset in fd to write at.
+ * @param offset Byte offset in the VFS container file.
+ * @param size Number of bytes to copy.
+ * @return true if all bytes were copied, false on error.
+ */
+bool disk_copy_to_fd(int fd, uint64_t fd_offset, uint64_t offset, uint64_t size);
+
+/**
+ * @brief Copies bytes of a host file descriptor into the container without staging them in user space.
+ *
+ * Same mechanism and fallback as disk_copy_to_fd(). Callers drop cached
+ * copies of the range first.
+ *
+ * @param fd Host descriptor opened for reading (a regular file for the kernel paths).
+ * @param fd_offset Byte offset in fd to read from.
+ * @param offset Byte offset in the VFS container file.
+ * @param size Number of bytes to copy.
+ * @return true if all bytes were copied, false on error or short input.
  */
-void disk_write(const void* buffer, uint32_t offset, uint32_t size);
+bool disk_copy_from_fd(int fd, uint64_t fd_offset, uint64_t offset, uint64_t size);
+
+/**
+ * @brief Returns a direct pointer into the mapped container.
+ *
+ * The pointer is read-only; modifications must go through disk_write() so
+ * the range gets flushed by fs_sync().
+ *
+ * @param offset Byte offset in the VFS container file.
+ * @param size Number of bytes the caller intends to access.
+ * @return Pointer into the mapping, or NULL if not mounted in FS_MOUNT_MMAP mode
+ *         or the range lies outside the container.
+ */
+const void* disk_peek(uint64_t offset, uint32_t size);
+
+/**
+ * @brief Reports whether the container is currently accessed through a mapping.
+ *
+ * @return true if mounted in FS_MOUNT_MMAP mode, false otherwise.
+ */
+bool disk_is_mapped(void);
+
+/**
+ * @brief Updates the next-fit allocation cursors in the in-memory superblock.
+ *
+ * Persisted by fs_sync() on version 2 images; version 1 superblocks have no
+ * room for them, so they only live for the duration of the mount there.
+ *
+ * @param next_inode Inode id where the next inode search should start.
+ * @param next_block Block id where the next block search should start.
+ */
+void fs_set_alloc_hints(uint64_t next_inode, uint64_t next_block);
+
+/**
+ * @brief Stores the free inode/block counters in the in-memory superblock.
+ *
+ * Written on the next fs_sync(); only version 2 images keep them on disk.
+ *
+ * @param free_inodes Number of free inodes.
+ * @param free_blocks Number of free data blocks.
+ */
+void fs_set_free_counts(uint64_t free_inodes, uint64_t free_blocks);
+
+/**
+ * @brief Reports whether the mounted image had been cleanly unmounted.
+ *
+ * When true, the free counters in the superblock are exact and a bitmap
+ * scan at mount can be skipped. Always false for version 1 images.
+ *
+ * @return true if the superblock was in FS_STATE_CLEAN at mount time.
+ */
+bool fs_mount_was_clean(void);
 
 /**
  * @brief Marks the in-memory inode bitmap as dirty (needs flushing).
@@ -98,9 +346,24 @@ void fs_mark_inode_bitmap_dirty(void);
  */
 void fs_mark_block_bitmap_dirty(void);
 
+/**
+ * @brief Marks one block used in the on-disk block bitmap now, if it is used in memory.
+ *
+ * Only that bit is changed on disk: a neighbour freed in memory must stay
+ * used on disk until the inode that dropped it is written. The bitmap
+ * stays dirty; fs_sync() still writes it whole.
+ *
+ * @param block_id Data block id.
+ * @return true on success, false on I/O error.
+ */
+bool fs_write_block_bitmap_bit(uint64_t block_id);
+
 /**
  * @brief Returns a pointer to the mounted superblock (in-memory).
  *
+ * Always in the version 2 layout; the version field tells which format is
+ * stored on disk.
+ *
  * @return Pointer to superblock or NULL if not mounted.
  */
 const struct superblock_disk* fs_get_superblock_disk(void);
@@ -122,12 +385,12 @@ uint8_t* fs_get_block_bitmap(void);
 /**
  * @brief Returns inode bitmap size in bytes as stored in the superblock.
  */
-uint32_t fs_get_inode_bitmap_size(void);
+uint64_t fs_get_inode_bitmap_size(void);
 
 /**
  * @brief Returns block bitmap size in bytes as stored in the superblock.
  */
-uint32_t fs_get_block_bitmap_size(void);
+uint64_t fs_get_block_bitmap_size(void);
 
 /**
  * @brief Reports whether the filesystem is currently mounted.
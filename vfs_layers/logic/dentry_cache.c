@@ -0,0 +1,170 @@
+#include "dentry_cache.h"
+#include "dir_index.h"
+#include "logic_layer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* One cached lookup: (parent, name) -> child, child -1 meaning "no such entry" */
+struct dentry_entry {
+    char name[MAX_FILENAME_LEN];    // Entry name, NUL-padded
+    int parent_inode;               // Directory the name was looked up in
+    int child_inode;                // Result, -1 for a negative entry
+    int hash_next;                  // Next slot in the same hash bucket, -1 terminates
+    bool used;                      // Slot holds an entry
+    bool referenced;                // CLOCK reference bit
+};
+
+static uint32_t configured_capacity = DENTRY_CACHE_DEFAULT_ENTRIES; // Applied by dentry_cache_init()
+
+static struct dentry_entry* entries = NULL; // Slots
+static int* buckets = NULL;                 // Hash heads, -1 for empty bucket
+static uint32_t bucket_mask = 0;            // Number of buckets - 1 (power of two)
+static uint32_t capacity = 0;               // Slots allocated; 0 means caching is off
+static uint32_t resident = 0;               // Slots ever used
+static uint32_t clock_hand = 0;             // Next eviction candidate
+
+static struct dentry_cache_stats stats;     // Counters since last init
+
+/* ---------------- Internal helpers ---------------- */
+
+static inline uint32_t hash_dentry(const int parent_inode, const char* name) {
+    return (dir_index_hash(name) ^ ((uint32_t)parent_inode * 2654435761u)) & bucket_mask;
+}
+
+// Names that cannot be stored in a directory entry are never cached
+static inline bool cacheable(const char* name) {
+    return strlen(name) < MAX_FILENAME_LEN;
+}
+
+static int lookup(const int parent_inode, const char* name) {
+    for (int i = buckets[hash_dentry(parent_inode, name)]; i >= 0; i = entries[i].hash_next) {
+        if (entries[i].parent_inode == parent_inode && strncmp(entries[i].name, name, MAX_FILENAME_LEN) == 0) return i;
+    }
+    return -1;
+}
+
+static void unlink_slot(const uint32_t slot) {
+    int* link = &buckets[hash_dentry(entries[slot].parent_inode, entries[slot].name)];
+    while (*link >= 0) {
+        if (*link == (int)slot) {
+            *link = entries[slot].hash_next;
+            return;
+        }
+        link = &entries[*link].hash_next;
+    }
+}
+
+// Find a slot: a never-used slot first, then a slot freed by forget, otherwise a CLOCK victim
+static uint32_t claim_slot(void) {
+    if (resident < capacity) return resident++;
+
+    for (;;) {
+        const uint32_t slot = clock_hand;
+        clock_hand = (clock_hand + 1) % capacity;
+        if (!entries[slot].used) return slot;
+        if (!entries[slot].referenced) {
+            unlink_slot(slot);
+            return slot;
+        }
+        entries[slot].referenced = false;
+    }
+}
+
+static void release(void) {
+    free(entries); entries = NULL;
+    free(buckets); buckets = NULL;
+    capacity = 0;
+    resident = 0;
+    clock_hand = 0;
+}
+
+// Disk-layer hook: entries describe the mounted image only
+static void flush_hook(const bool unmounting) {
+    if (unmounting) release();
+}
+
+/* ---------------- Public API ---------------- */
+
+void dentry_cache_set_capacity(const uint32_t count) {
+    configured_capacity = count;
+}
+
+bool dentry_cache_init(void) {
+    release();
+    memset(&stats, 0, sizeof(stats));
+    if (configured_capacity == 0) return true;
+
+    uint32_t nbuckets = 1;
+    while (nbuckets < configured_capacity * 2) nbuckets <<= 1;
+
+    entries = calloc(configured_capacity, sizeof(*entries));
+    buckets = malloc(nbuckets * sizeof(*buckets));
+    if (!entries || !buckets) {
+        fprintf(stderr, "dentry_cache_init: cannot allocate %u entries, caching disabled\n", configured_capacity);
+        release();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nbuckets; i++) buckets[i] = -1;
+    bucket_mask = nbuckets - 1;
+    capacity = configured_capacity;
+
+    fs_register_flush_hook(flush_hook);
+    return true;
+}
+
+bool dentry_cache_lookup(const int parent_inode, const char* name, int* child_inode) {
+    if (capacity == 0 || !cacheable(name)) return false;
+
+    const int slot = lookup(parent_inode, name);
+    if (slot < 0) {
+        stats.misses++;
+        return false;
+    }
+
+    entries[slot].referenced = true;
+    *child_inode = entries[slot].child_inode;
+    if (*child_inode < 0) stats.negative_hits++;
+    else stats.hits++;
+    return true;
+}
+
+void dentry_cache_store(const int parent_inode, const char* name, const int child_inode) {
+    if (capacity == 0 || !cacheable(name)) return;
+
+    int slot = lookup(parent_inode, name);
+    if (slot < 0) {
+        slot = (int)claim_slot();
+        struct dentry_entry* e = &entries[slot];
+        // The slot may hold an evicted name; cacheable() guarantees this one fits with its terminator
+        memset(e->name, 0, sizeof(e->name));
+        memcpy(e->name, name, strlen(name));
+        e->parent_inode = parent_inode;
+        e->used = true;
+
+        const uint32_t b = hash_dentry(parent_inode, name);
+        e->hash_next = buckets[b];
+        buckets[b] = slot;
+    }
+
+    entries[slot].child_inode = child_inode < 0 ? -1 : child_inode;
+    entries[slot].referenced = true;
+}
+
+void dentry_cache_forget_directory(const int parent_inode) {
+    if (capacity == 0) return;
+
+    // Rare (rmdir) and bounded by the capacity, so a full sweep is fine
+    for (uint32_t i = 0; i < resident; i++) {
+        if (!entries[i].used || entries[i].parent_inode != parent_inode) continue;
+        unlink_slot(i);
+        entries[i].used = false;
+        entries[i].referenced = false;
+    }
+}
+
+void dentry_cache_get_stats(struct dentry_cache_stats* out) {
+    *out = stats;
+    out->capacity = capacity;
+}
@@ -0,0 +1,78 @@
+#ifndef FILE_SYSTEM_DENTRY_CACHE_H
+#define FILE_SYSTEM_DENTRY_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Default number of (parent, name) lookups kept in memory.
+ */
+#define DENTRY_CACHE_DEFAULT_ENTRIES 4096
+
+/**
+ * @brief Counters describing dentry cache effectiveness since the last mount.
+ */
+struct dentry_cache_stats {
+    /** @brief Configured capacity in entries. */
+    uint32_t capacity;
+    /** @brief Lookups answered with a cached child inode. */
+    uint64_t hits;
+    /** @brief Lookups answered with a cached "no such entry". */
+    uint64_t negative_hits;
+    /** @brief Lookups that had to scan the directory. */
+    uint64_t misses;
+};
+
+/**
+ * @brief Sets the capacity used by the next dentry_cache_init().
+ *
+ * A capacity of 0 disables caching.
+ *
+ * @param count Number of lookups the cache may hold.
+ */
+void dentry_cache_set_capacity(uint32_t count);
+
+/**
+ * @brief (Re)initializes the cache for the mounted filesystem.
+ *
+ * Drops previous contents, resets statistics and registers a hook that
+ * drops everything again on fs_unmount().
+ *
+ * @return true on success, false if the cache memory could not be allocated.
+ */
+bool dentry_cache_init(void);
+
+/**
+ * @brief Looks up a cached directory entry.
+ *
+ * @param parent_inode Directory inode id.
+ * @param name Entry name.
+ * @param child_inode Output: child inode id, or -1 for a cached negative entry.
+ * @return true if the lookup was answered from the cache.
+ */
+bool dentry_cache_lookup(int parent_inode, const char* name, int* child_inode);
+
+/**
+ * @brief Records the result of a lookup or a directory change.
+ *
+ * @param parent_inode Directory inode id.
+ * @param name Entry name.
+ * @param child_inode Child inode id, or -1 to record that the entry does not exist.
+ */
+void dentry_cache_store(int parent_inode, const char* name, int child_inode);
+
+/**
+ * @brief Drops every entry cached under a directory that is being deleted.
+ *
+ * @param parent_inode Directory inode id.
+ */
+void dentry_cache_forget_directory(int parent_inode);
+
+/**
+ * @brief Copies the current cache counters into stats.
+ *
+ * @param stats Output structure.
+ */
+void dentry_cache_get_stats(struct dentry_cache_stats* stats);
+
+#endif // FILE_SYSTEM_DENTRY_CACHE_H
@@ -0,0 +1,311 @@
+#include "dir_index.h"
+#include "dir_scan.h"
+#include "logic_layer.h"
+#include "../meta/block_map.h"
+
+/** @brief Entry slots of a bucket after its header. */
+#define BUCKET_ENTRIES (DIR_SLOTS_PER_BLOCK - 1)
+
+/* Bucket block: header slot followed by entries */
+union dir_bucket {
+    struct {
+        struct dir_bucket_header header;
+        struct directory_item items[BUCKET_ENTRIES];
+    };
+    uint8_t raw[BLOCK_SIZE];
+};
+
+static inline uint32_t low_bits(const uint32_t hash, const int bits) {
+    return hash & ((1u << bits) - 1);
+}
+
+// Data block behind file block logical, FS_INVALID_BLOCK if unmapped
+static uint32_t mapped_block(const struct pseudo_inode* dir, const uint32_t logical) {
+    uint32_t physical;
+    block_map_lookup(dir, logical, 1, &physical);
+    return physical;
+}
+
+static void init_bucket(union dir_bucket* bucket, const int local_depth) {
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->header.magic = DIR_BUCKET_MAGIC;
+    bucket->header.local_depth = (uint8_t)local_depth;
+    bucket->header.inode_id = FS_INVALID_INODE;
+    for (int i = 0; i < BUCKET_ENTRIES; i++) bucket->items[i].inode_id = FS_INVALID_INODE;
+}
+
+static bool load_bucket(const uint32_t block, union dir_bucket* bucket) {
+    if (!read_block((int)block, bucket)) return false;
+    if (bucket->header.magic != DIR_BUCKET_MAGIC) {
+        printf("ERROR: corrupted directory bucket in block %u\n", block);
+        return false;
+    }
+    return true;
+}
+
+// Bucket block the index assigns to hash
+static uint32_t bucket_for(const struct pseudo_inode* dir, const uint32_t hash) {
+    const uint32_t slot = low_bits(hash, dir->dir_depth);
+    const uint32_t block = mapped_block(dir, DIR_INDEX_FIRST_BLOCK + slot / DIR_INDEX_PER_BLOCK);
+    if (block == FS_INVALID_BLOCK) {
+        printf("ERROR: missing index block in directory (inode %u)\n", dir->id);
+        return FS_INVALID_BLOCK;
+    }
+
+    const uint32_t* index = peek_block((int)block);
+    if (index) return index[slot % DIR_INDEX_PER_BLOCK];
+
+    uint32_t local[DIR_INDEX_PER_BLOCK];
+    read_block((int)block, local);
+    return local[slot % DIR_INDEX_PER_BLOCK];
+}
+
+// Points index slots first, first + step, ... at bucket; each index block is rewritten once
+static void update_index(const struct pseudo_inode* dir, const uint32_t first, const uint32_t step, const uint32_t bucket) {
+    const uint32_t slots = 1u << dir->dir_depth;
+    uint32_t table[DIR_INDEX_PER_BLOCK];
+    uint32_t loaded = UINT32_MAX;   // Index block held in table
+    uint32_t block = FS_INVALID_BLOCK;
+
+    for (uint32_t slot = first; slot < slots; slot += step) {
+        if (slot / DIR_INDEX_PER_BLOCK != loaded) {
+            if (loaded != UINT32_MAX) write_block((int)block, table);
+            loaded = slot / DIR_INDEX_PER_BLOCK;
+            block = mapped_block(dir, DIR_INDEX_FIRST_BLOCK + loaded);
+            read_block((int)block, table);
+        }
+        table[slot % DIR_INDEX_PER_BLOCK] = bucket;
+    }
+    if (loaded != UINT32_MAX) write_block((int)block, table);
+}
+
+// Doubles the index: with low-bit addressing the upper half is a copy of the lower half
+static bool double_index(struct pseudo_inode* dir) {
+    if (dir->dir_depth >= DIR_INDEX_MAX_DEPTH) {
+        printf("ERROR: Directory (inode %u) is full\n", dir->id);
+        return false;
+    }
+
+    const uint32_t slots = 1u << dir->dir_depth;
+    if (slots * 2 <= DIR_INDEX_PER_BLOCK) {
+        const uint32_t block = mapped_block(dir, DIR_INDEX_FIRST_BLOCK);
+        uint32_t table[DIR_INDEX_PER_BLOCK];
+        read_block((int)block, table);
+        memcpy(table + slots, table, slots * sizeof(uint32_t));
+        write_block((int)block, table);
+        dir->dir_depth++;
+        return true;
+    }
+
+    const uint32_t blocks = slots / DIR_INDEX_PER_BLOCK;
+    struct block_extent* runs = malloc(blocks * sizeof(*runs));
+    const int count = runs ? allocate_free_blocks(blocks, runs, (int)blocks) : -1;
+    if (count < 0) {
+        free(runs);
+        printf("ERROR: No free blocks available for directory (inode %u)\n", dir->id);
+        return false;
+    }
+
+    uint32_t copied = 0;
+    for (int r = 0; r < count; r++) {
+        if (!block_map_insert(dir, DIR_INDEX_FIRST_BLOCK + blocks + copied, runs[r].start, runs[r].length)) {
+            // Drop the partial copy so the next attempt starts from an unmapped range
+            block_map_truncate(dir, DIR_INDEX_FIRST_BLOCK + blocks);
+            for (int k = r; k < count; k++) free_block_run(runs[k].start, runs[k].length);
+            free(runs);
+            return false;
+        }
+
+        for (uint32_t i = 0; i < runs[r].length; i++, copied++) {
+            uint32_t table[DIR_INDEX_PER_BLOCK];
+            read_block((int)mapped_block(dir, DIR_INDEX_FIRST_BLOCK + copied), table);
+            write_block((int)(runs[r].start + i), table);
+        }
+    }
+
+    free(runs);
+    dir->dir_depth++;
+    return true;
+}
+
+// Splits the full bucket in block by the next hash bit; hash is any hash that maps to it
+static bool split_bucket(struct pseudo_inode* dir, const uint32_t block, union dir_bucket* bucket, const uint32_t hash) {
+    const int depth = bucket->header.local_depth;
+    if (depth == dir->dir_depth && !double_index(dir)) return false;
+
+    // The new bucket becomes the next file block of the directory
+    const uint32_t logical = (uint32_t)(dir->file_size / BLOCK_SIZE);
+    const int sibling_block = allocate_free_block();
+    if (sibling_block < 0) {
+        printf("ERROR: No free blocks available for directory (inode %u)\n", dir->id);
+        return false;
+    }
+    if (!block_map_insert(dir, logical, (uint32_t)sibling_block, 1)) {
+        free_block(sibling_block);
+        return false;
+    }
+    dir->file_size += BLOCK_SIZE;
+
+    union dir_bucket sibling;
+    init_bucket(&sibling, depth + 1);
+    bucket->header.local_depth = (uint8_t)(depth + 1);
+
+    int moved = 0;
+    for (int i = 0; i < BUCKET_ENTRIES; i++) {
+        struct directory_item* item = &bucket->items[i];
+        if (item->inode_id == FS_INVALID_INODE || !((dir_index_hash(item->name) >> depth) & 1)) continue;
+
+        sibling.items[moved++] = *item;
+        memset(item->name, 0, sizeof(item->name));
+        item->inode_id = FS_INVALID_INODE;
+    }
+
+    write_block((int)block, bucket);
+    write_block(sibling_block, &sibling);
+
+    // Slots that share the bucket's low bits and have the new bit set move to the sibling
+    update_index(dir, low_bits(hash, depth) | (1u << depth), 1u << (depth + 1), (uint32_t)sibling_block);
+    return true;
+}
+
+/* ---------------- Public API ---------------- */
+
+uint32_t dir_index_hash(const char* name) {
+    // FNV-1a over the stored name bytes
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < MAX_FILENAME_LEN && name[i] != '\0'; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool dir_index_create(struct pseudo_inode* dir) {
+    const uint32_t first = mapped_block(dir, 0);
+    if (first == FS_INVALID_BLOCK) return false;
+
+    struct directory_item entries[DIR_SLOTS_PER_BLOCK];
+    if (!read_block((int)first, entries)) return false;
+
+    // The index is built in fresh blocks under a copy of the inode; dir and its
+    // entry block stay untouched until every entry has been re-added
+    struct pseudo_inode staged = *dir;
+    block_map_init(&staged);
+    staged.flags |= INODE_FLAG_DIR_INDEX;
+    staged.dir_depth = 0;
+    staged.file_size = BLOCK_SIZE;
+
+    // A block mapped into the copy is given back by block_map_release() below, an unmapped one here
+    const int bucket_block = allocate_free_block();
+    bool ok = bucket_block >= 0 && block_map_insert(&staged, 0, (uint32_t)bucket_block, 1);
+    if (bucket_block >= 0 && !ok) free_block(bucket_block);
+
+    const int index_block = ok ? allocate_free_block() : -1;
+    ok = index_block >= 0 && block_map_insert(&staged, DIR_INDEX_FIRST_BLOCK, (uint32_t)index_block, 1);
+    if (index_block >= 0 && !ok) free_block(index_block);
+    if (!ok) printf("ERROR: No free blocks available for directory (inode %u)\n", dir->id);
+
+    if (ok) {
+        uint32_t table[DIR_INDEX_PER_BLOCK];
+        for (int i = 0; i < DIR_INDEX_PER_BLOCK; i++) table[i] = FS_INVALID_BLOCK;
+        table[0] = (uint32_t)bucket_block;
+        write_block(index_block, table);
+
+        // Bucket 0 covers every hash until the first split
+        union dir_bucket bucket;
+        init_bucket(&bucket, 0);
+        write_block(bucket_block, &bucket);
+    }
+
+    for (int i = 0; ok && i < DIR_SLOTS_PER_BLOCK; i++) {
+        if (entries[i].inode_id == FS_INVALID_INODE) continue;
+
+        char name[MAX_FILENAME_LEN + 1];
+        memcpy(name, entries[i].name, MAX_FILENAME_LEN);
+        name[MAX_FILENAME_LEN] = '\0';
+        ok = dir_index_add(&staged, name, entries[i].inode_id);
+    }
+
+    if (!ok) {
+        // Buckets, index and map nodes of the copy go back; the directory keeps its old block
+        block_map_release(&staged);
+        return false;
+    }
+
+    *dir = staged;
+    free_block((int)first);
+    return true;
+}
+
+int dir_index_find(const struct pseudo_inode* dir, const char* name) {
+    const uint32_t block = bucket_for(dir, dir_index_hash(name));
+    if (block == FS_INVALID_BLOCK) return -1;
+
+    // Scan the bucket in place when possible, otherwise copy it in
+    union dir_bucket local;
+    const union dir_bucket* bucket = peek_block((int)block);
+    if (!bucket || bucket->header.magic != DIR_BUCKET_MAGIC) {
+        if (!load_bucket(block, &local)) return -1;
+        bucket = &local;
+    }
+
+    const int slot = dir_scan_find(bucket->items, BUCKET_ENTRIES, name);
+    return slot < 0 ? -1 : (int)bucket->items[slot].inode_id;
+}
+
+bool dir_index_add(struct pseudo_inode* dir, const char* name, const uint32_t child_inode) {
+    const uint32_t hash = dir_index_hash(name);
+
+    // Each pass either stores the entry or splits its full bucket and retries
+    for (;;) {
+        const uint32_t block = bucket_for(dir, hash);
+        union dir_bucket bucket;
+        if (block == FS_INVALID_BLOCK || !load_bucket(block, &bucket)) return false;
+
+        for (int i = 0; i < BUCKET_ENTRIES; i++) {
+            if (bucket.items[i].inode_id != FS_INVALID_INODE) continue;
+
+            strncpy(bucket.items[i].name, name, sizeof(bucket.items[i].name));
+            bucket.items[i].inode_id = child_inode;
+            write_block((int)block, &bucket);
+            return true;
+        }
+
+        if (!split_bucket(dir, block, &bucket, hash)) return false;
+    }
+}
+
+bool dir_index_remove(const struct pseudo_inode* dir, const char* name) {
+    const uint32_t block = bucket_for(dir, dir_index_hash(name));
+    union dir_bucket bucket;
+    if (block == FS_INVALID_BLOCK || !load_bucket(block, &bucket)) return false;
+
+    const int slot = dir_scan_find(bucket.items, BUCKET_ENTRIES, name);
+    if (slot < 0) return false;
+
+    memset(bucket.items[slot].name, 0, sizeof(bucket.items[slot].name));
+    bucket.items[slot].inode_id = FS_INVALID_INODE;
+    write_block((int)block, &bucket);
+    return true;
+}
+
+bool dir_index_rename(struct pseudo_inode* dir, const char* old_name, const char* new_name) {
+    const uint32_t block = bucket_for(dir, dir_index_hash(old_name));
+    union dir_bucket bucket;
+    if (block == FS_INVALID_BLOCK || !load_bucket(block, &bucket)) return false;
+
+    const int slot = dir_scan_find(bucket.items, BUCKET_ENTRIES, old_name);
+    if (slot < 0) return false;
+
+    // Both names hash to this bucket: rewrite the name, a single block write
+    if (bucket_for(dir, dir_index_hash(new_name)) == block) {
+        strncpy(bucket.items[slot].name, new_name, sizeof(bucket.items[slot].name));
+        return write_block((int)block, &bucket);
+    }
+
+    // Link under the new name before dropping the old one, and get the link to disk first
+    record_block_writes();
+    const bool added = dir_index_add(dir, new_name, bucket.items[slot].inode_id);
+    if (!sync_recorded_writes((int)dir->id, dir) || !added) return false;
+    return dir_index_remove(dir, old_name);
+}
@@ -0,0 +1,106 @@
+#ifndef FILE_SYSTEM_DIR_INDEX_H
+#define FILE_SYSTEM_DIR_INDEX_H
+
+#include "../meta/meta_layer.h"
+
+/**
+ * @brief Hashed multi-block directories (extendible hashing).
+ *
+ * A directory starts with all entries in its first block. When that block
+ * fills up on an extent image it is converted: file blocks 0..n-1 become
+ * buckets, each opened by a struct dir_bucket_header, and file blocks from
+ * DIR_INDEX_FIRST_BLOCK on hold an index of 2^dir_depth bucket block ids
+ * addressed by the low bits of the name hash. A lookup, insert or remove
+ * reads one index block and one bucket; a full bucket is split in two and
+ * the index doubles when a bucket's local depth reaches the global one.
+ *
+ * inode.file_size of an indexed directory is n * BLOCK_SIZE.
+ */
+
+/**
+ * @brief File block holding the first index block of an indexed directory.
+ */
+#define DIR_INDEX_FIRST_BLOCK 0x80000000u
+
+/**
+ * @brief Bucket block ids per index block.
+ */
+#define DIR_INDEX_PER_BLOCK (BLOCK_SIZE / (int)sizeof(uint32_t))
+
+/**
+ * @brief Largest global depth; 2^20 buckets hold well over 10^8 entries.
+ */
+#define DIR_INDEX_MAX_DEPTH 20
+
+/**
+ * @brief Entry slots per directory block (the first one is the header in buckets).
+ */
+#define DIR_SLOTS_PER_BLOCK (BLOCK_SIZE / (int)sizeof(struct directory_item))
+
+/**
+ * @brief Hash of an entry name used to pick its bucket.
+ *
+ * @param name Entry name, at most MAX_FILENAME_LEN bytes are considered.
+ * @return 32-bit hash.
+ */
+uint32_t dir_index_hash(const char* name);
+
+/**
+ * @brief Converts a directory whose first block is full into an indexed one.
+ *
+ * The existing entries are rehashed into buckets built in fresh blocks;
+ * only once all of them are in is dir switched over and the old entry
+ * block freed. The inode gets INODE_FLAG_DIR_INDEX and must be written
+ * back by the caller.
+ *
+ * @param dir Directory inode (extent mapped).
+ * @return true on success, false if blocks ran out (dir and its entries
+ *         are then unchanged).
+ */
+bool dir_index_create(struct pseudo_inode* dir);
+
+/**
+ * @brief Looks a name up in an indexed directory.
+ *
+ * @param dir Directory inode with INODE_FLAG_DIR_INDEX.
+ * @param name Entry name.
+ * @return Inode id of the entry, or -1 if not present.
+ */
+int dir_index_find(const struct pseudo_inode* dir, const char* name);
+
+/**
+ * @brief Adds an entry to an indexed directory, splitting its bucket if full.
+ *
+ * May grow the directory; the caller writes the inode back.
+ *
+ * @param dir Directory inode with INODE_FLAG_DIR_INDEX.
+ * @param name Entry name.
+ * @param child_inode Referenced inode id.
+ * @return true on success, false if blocks ran out or the index is at DIR_INDEX_MAX_DEPTH.
+ */
+bool dir_index_add(struct pseudo_inode* dir, const char* name, uint32_t child_inode);
+
+/**
+ * @brief Removes an entry from an indexed directory.
+ *
+ * @param dir Directory inode with INODE_FLAG_DIR_INDEX.
+ * @param name Entry name.
+ * @return true if the entry was found and removed.
+ */
+bool dir_index_remove(const struct pseudo_inode* dir, const char* name);
+
+/**
+ * @brief Renames an entry of an indexed directory.
+ *
+ * When both names map to the same bucket the name is rewritten in place;
+ * otherwise the entry is added under the new name first and then removed.
+ * May grow the directory; the caller writes the inode back.
+ *
+ * @param dir Directory inode with INODE_FLAG_DIR_INDEX.
+ * @param old_name Current name.
+ * @param new_name New name, not present in the directory.
+ * @return true on success, false if old_name is missing or blocks ran out.
+ */
+bool dir_index_rename(struct pseudo_inode* dir, const char* old_name, const char* new_name);
+
+#endif // FILE_SYSTEM_DIR_INDEX_H
@@ -0,0 +1,106 @@
+#include "dir_scan.h"
+#include "logic_layer.h"
+
+/*
+ * On x86-64 with GCC or Clang, records are compared as 16-byte vectors:
+ * SSE2 is part of the base ISA, the AVX2 kernel is compiled for that target
+ * only and picked once the CPU has been checked. Elsewhere the scalar loop
+ * is used as is.
+ */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DIR_SCAN_SIMD 1
+#include <immintrin.h>
+#endif
+
+_Static_assert(sizeof(struct directory_item) == 16, "a directory entry must fill one 16-byte vector");
+
+/* Lookup key: the record bytes strncmp() would look at, laid out like a directory_item */
+struct scan_key {
+    uint8_t bytes[sizeof(struct directory_item)];
+    uint32_t need;  // Bit i set: record byte i must equal bytes[i]
+    size_t length;  // Number of name bytes compared
+};
+
+static void make_key(const char* name, struct scan_key* key) {
+    memset(key, 0, sizeof(*key));
+    size_t len = 0;
+    while (len < MAX_FILENAME_LEN && name[len] != '\0') len++;
+
+    // The terminator takes part in the comparison unless the name fills the field
+    key->length = len < MAX_FILENAME_LEN ? len + 1 : MAX_FILENAME_LEN;
+    memcpy(key->bytes, name, len);
+    key->need = (1u << key->length) - 1;
+}
+
+typedef int (*scan_fn)(const struct directory_item* items, int count, const struct scan_key* key);
+
+#ifdef DIR_SCAN_SIMD
+
+// Movemask bits of the inode_id bytes; all four set means FS_INVALID_INODE (empty slot)
+#define INODE_BYTES 0xF000u
+
+// Record hit from its 16 compare bits against the key and against 0xFF
+static inline bool record_hit(const uint32_t same, const uint32_t ones, const uint32_t need) {
+    return (same & need) == need && (ones & INODE_BYTES) != INODE_BYTES;
+}
+
+static int scan_sse2(const struct directory_item* items, const int count, const struct scan_key* key) {
+    const __m128i want = _mm_loadu_si128((const __m128i*)key->bytes);
+    const __m128i ones = _mm_set1_epi8(-1);
+
+    for (int i = 0; i < count; i++) {
+        const __m128i record = _mm_loadu_si128((const __m128i*)&items[i]);
+        const uint32_t same = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(record, want));
+        const uint32_t empty = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(record, ones));
+        if (record_hit(same, empty, key->need)) return i;
+    }
+    return -1;
+}
+
+// Two records per 256-bit compare; an odd last record goes through SSE2
+__attribute__((target("avx2")))
+static int scan_avx2(const struct directory_item* items, const int count, const struct scan_key* key) {
+    const __m256i want = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)key->bytes));
+    const __m256i ones = _mm256_set1_epi8(-1);
+
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m256i records = _mm256_loadu_si256((const __m256i*)&items[i]);
+        const uint32_t same = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(records, want));
+        const uint32_t empty = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(records, ones));
+        if (record_hit(same, empty, key->need)) return i;
+        if (record_hit(same >> 16, empty >> 16, key->need)) return i + 1;
+    }
+
+    if (i < count && scan_sse2(items + i, 1, key) == 0) return i;
+    return -1;
+}
+
+static scan_fn pick_kernel(void) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? scan_avx2 : scan_sse2;
+}
+
+#else
+
+static int scan_scalar(const struct directory_item* items, const int count, const struct scan_key* key) {
+    for (int i = 0; i < count; i++) {
+        if (items[i].inode_id != FS_INVALID_INODE && memcmp(items[i].name, key->bytes, key->length) == 0) return i;
+    }
+    return -1;
+}
+
+static scan_fn pick_kernel(void) {
+    return scan_scalar;
+}
+
+#endif
+
+int dir_scan_find(const struct directory_item* items, const int count, const char* name) {
+    static scan_fn kernel = NULL;
+    if (!kernel) kernel = pick_kernel();
+
+    struct scan_key key;
+    make_key(name, &key);
+    return kernel(items, count, &key);
+}
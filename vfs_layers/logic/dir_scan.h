@@ -0,0 +1,21 @@
+#ifndef FILE_SYSTEM_DIR_SCAN_H
+#define FILE_SYSTEM_DIR_SCAN_H
+
+#include "../meta/meta_layer.h"
+
+/**
+ * @brief Finds the slot holding name in an array of directory entries.
+ *
+ * Matches exactly what strncmp(item.name, name, MAX_FILENAME_LEN) == 0 on
+ * an occupied slot would. On x86-64 whole 16-byte records are compared with
+ * SSE2, or two at a time with AVX2 when the host CPU supports it (detected
+ * at runtime); other targets use the scalar loop.
+ *
+ * @param items Directory entries (any alignment).
+ * @param count Number of entries.
+ * @param name Entry name.
+ * @return Index of the first occupied entry named name, or -1.
+ */
+int dir_scan_find(const struct directory_item* items, int count, const char* name);
+
+#endif // FILE_SYSTEM_DIR_SCAN_H
@@ -1,5 +1,43 @@
 #include "logic_layer.h"
+#include "dentry_cache.h"
+#include "dir_index.h"
+#include "dir_scan.h"
+#include "../meta/block_map.h"
+
+// Data block holding a directory's entries, or -1 if none has been allocated yet
+static int directory_block(const struct pseudo_inode* inode) {
+    uint32_t block;
+    block_map_lookup(inode, 0, 1, &block);
+    return block == FS_INVALID_BLOCK ? -1 : (int)block;
+}
+
+static inline bool is_indexed(const struct pseudo_inode* inode) {
+    return (inode->flags & INODE_FLAG_DIR_INDEX) != 0;
+}
+
+// File blocks holding entries: the buckets of an indexed directory, the first block otherwise
+static uint32_t entry_blocks(const struct pseudo_inode* inode) {
+    return is_indexed(inode) ? (uint32_t)(inode->file_size / BLOCK_SIZE) : 1;
+}
 
+// Allocates a directory's entry block, fills it with empty slots and maps it as file block 0
+static int attach_directory_block(struct pseudo_inode* inode) {
+    const int block = allocate_free_block();
+    if (block < 0) return -1;
+
+    if (!block_map_insert(inode, 0, (uint32_t)block, 1)) {
+        free_block(block);
+        return -1;
+    }
+
+    struct directory_item zeroes[BLOCK_SIZE / sizeof(struct directory_item)];
+    memset(zeroes, 0, sizeof(zeroes));
+    for (int i = 0; i < (int)(BLOCK_SIZE / sizeof(struct directory_item)); i++) {
+        zeroes[i].inode_id = FS_INVALID_INODE;
+    }
+    write_block(block, zeroes);
+    return block;
+}
 
 bool is_directory_empty(const int inode_id) {
     // A directory is considered empty if it has no valid directory entries.
@@ -11,20 +49,19 @@ bool is_directory_empty(const int inode_id) {
         exit(1);
     }
 
-    // Directory has never allocated its first data block => empty
-    if (inode.direct_blocks[0] == FS_INVALID_BLOCK)
-        return true;
-
-    // Read directory entries stored in the first direct block
-    const int items = BLOCK_SIZE / (int)sizeof(struct directory_item);
-    struct directory_item buffer[items];
-
-    read_block((int)inode.direct_blocks[0], buffer);
-
-    // Any non-empty slot means the directory is not empty
-    for (int j = 0; j < items; j++) {
-        if (buffer[j].inode_id != FS_INVALID_INODE)
-            return false;
+    // Any occupied slot in any entry block means the directory is not empty
+    struct directory_item buffer[DIR_SLOTS_PER_BLOCK];
+    const uint32_t blocks = entry_blocks(&inode);
+    for (uint32_t b = 0; b < blocks; b++) {
+        uint32_t block;
+        block_map_lookup(&inode, b, 1, &block);
+        if (block == FS_INVALID_BLOCK) continue;
+
+        read_block((int)block, buffer);
+        for (int j = 0; j < DIR_SLOTS_PER_BLOCK; j++) {
+            if (buffer[j].inode_id != FS_INVALID_INODE)
+                return false;
+        }
     }
 
     return true;
@@ -73,7 +110,38 @@ bool split_path(const char* path, char* parent, char* name) {
 
 
 
+void logic_init(void) {
+    dentry_cache_init();
+}
+
+// Directory scan behind find_item_in_directory(); -1 also when the name is absent
+static int scan_directory(const struct pseudo_inode* dir, const char* name) {
+    if (is_indexed(dir))
+        return dir_index_find(dir, name);
+
+    const int block = directory_block(dir);
+    if (block < 0)
+        return -1;
+
+    const int items = BLOCK_SIZE / sizeof(struct directory_item);
+    struct directory_item local[items];
+
+    // Scan the mapped block in place when possible, otherwise copy it in
+    const struct directory_item* buffer = peek_block(block);
+    if (!buffer) {
+        read_block(block, local);
+        buffer = local;
+    }
+
+    const int slot = dir_scan_find(buffer, items, name);
+    return slot < 0 ? -1 : (int)buffer[slot].inode_id;
+}
+
 int find_item_in_directory(const int parent_inode, const char* name) {
+    // Repeated lookups, including misses, are answered without reading the directory
+    int child;
+    if (dentry_cache_lookup(parent_inode, name, &child)) return child;
+
     struct pseudo_inode inode;
     read_inode(parent_inode, &inode);
 
@@ -82,23 +150,14 @@ int find_item_in_directory(const int parent_inode, const char* name) {
         return -1;
     }
 
-    if (inode.direct_blocks[0] == FS_INVALID_BLOCK)
-        return -1;
-
-    const int items = BLOCK_SIZE / sizeof(struct directory_item);
-    struct directory_item buffer[items];
-    read_block((int)inode.direct_blocks[0], buffer);
-
-    for (int i = 0; i < items; i++) {
-        if (buffer[i].inode_id != FS_INVALID_INODE && strcmp(buffer[i].name, name) == 0)
-            return (int)buffer[i].inode_id;
-    }
-
-    return -1;
+    child = scan_directory(&inode, name);
+    dentry_cache_store(parent_inode, name, child);
+    return child;
 }
 
 
-bool add_directory_item(const int parent_inode, const char* name, const int child_inode) {
+// Stores the entry in the parent directory, growing or converting it as needed
+static bool insert_entry(const int parent_inode, const char* name, const int child_inode) {
     struct pseudo_inode inode;
     read_inode(parent_inode, &inode);
 
@@ -107,36 +166,48 @@ bool add_directory_item(const int parent_inode, const char* name, const int chil
         return false;
     }
 
-    if (inode.direct_blocks[0] == FS_INVALID_BLOCK) {
-        inode.direct_blocks[0] = (uint32_t)allocate_free_block();
+    if (is_indexed(&inode)) {
+        const bool added = dir_index_add(&inode, name, (uint32_t)child_inode);
         write_inode(parent_inode, &inode);
+        return added;
+    }
 
-        struct directory_item zeroes[BLOCK_SIZE / sizeof(struct directory_item)];
-        memset(zeroes, 0, sizeof(zeroes));
-        for (int i = 0; i < (int)(BLOCK_SIZE / sizeof(struct directory_item)); i++) {
-            zeroes[i].inode_id = FS_INVALID_INODE;
+    int block = directory_block(&inode);
+    if (block < 0) {
+        block = attach_directory_block(&inode);
+        if (block < 0) {
+            printf("ERROR: No free blocks available for directory (inode %d)\n", parent_inode);
+            return false;
         }
-        write_block((int)inode.direct_blocks[0], zeroes);
+        write_inode(parent_inode, &inode);
     }
 
     struct directory_item buffer[BLOCK_SIZE / sizeof(struct directory_item)];
-    read_block((int)inode.direct_blocks[0], buffer);
+    read_block(block, buffer);
     const int items = BLOCK_SIZE / sizeof(struct directory_item);
 
     for (int i = 0; i < items; i++) {
         if (buffer[i].inode_id == FS_INVALID_INODE) {
             strcpy(buffer[i].name, name);
             buffer[i].inode_id = (uint32_t)child_inode;
-            write_block((int)inode.direct_blocks[0], buffer);
+            write_block(block, buffer);
             return true;
         }
     }
 
+    // The first block is full: extent-mapped directories switch to hashed buckets
+    if (inode.flags & INODE_FLAG_EXTENTS) {
+        const bool added = dir_index_create(&inode) && dir_index_add(&inode, name, (uint32_t)child_inode);
+        write_inode(parent_inode, &inode);
+        return added;
+    }
+
     printf("ERROR: Directory (inode %d) is full\n", parent_inode);
     return false;
 }
 
-bool remove_directory_item(const int parent_inode, const char* name) {
+// Clears the entry from the parent directory
+static bool erase_entry(const int parent_inode, const char* name) {
     struct pseudo_inode inode;
     read_inode(parent_inode, &inode);
 
@@ -145,26 +216,126 @@ bool remove_directory_item(const int parent_inode, const char* name) {
         return false;
     }
 
-    if (inode.direct_blocks[0] == FS_INVALID_BLOCK)
+    if (is_indexed(&inode))
+        return dir_index_remove(&inode, name);
+
+    const int block = directory_block(&inode);
+    if (block < 0)
         return false;
 
     struct directory_item buffer[BLOCK_SIZE / sizeof(struct directory_item)];
-    read_block((int)inode.direct_blocks[0], buffer);
+    read_block(block, buffer);
     const int items = BLOCK_SIZE / sizeof(struct directory_item);
 
-    for (int i = 0; i < items; i++) {
-        if (strcmp(buffer[i].name, name) == 0) {
-            buffer[i].inode_id = FS_INVALID_INODE;
-            buffer[i].name[0] = '\0';
-            write_block((int)inode.direct_blocks[0], buffer);
-            return true;
-        }
+    const int slot = dir_scan_find(buffer, items, name);
+    if (slot < 0)
+        return false;
+
+    buffer[slot].inode_id = FS_INVALID_INODE;
+    buffer[slot].name[0] = '\0';
+    write_block(block, buffer);
+    return true;
+}
+
+
+// Rewrites the name of an entry inside its directory
+static bool rename_in_place(const int dir_inode, const char* old_name, const char* new_name) {
+    struct pseudo_inode inode;
+    read_inode(dir_inode, &inode);
+
+    if (!inode.is_directory) {
+        printf("ERROR: inode %d is not a directory\n", dir_inode);
+        return false;
     }
 
-    return false;
+    if (is_indexed(&inode)) {
+        const bool renamed = dir_index_rename(&inode, old_name, new_name);
+        write_inode(dir_inode, &inode);
+        return renamed;
+    }
+
+    const int block = directory_block(&inode);
+    if (block < 0)
+        return false;
+
+    struct directory_item buffer[BLOCK_SIZE / sizeof(struct directory_item)];
+    read_block(block, buffer);
+
+    const int slot = dir_scan_find(buffer, DIR_SLOTS_PER_BLOCK, old_name);
+    if (slot < 0)
+        return false;
+
+    strncpy(buffer[slot].name, new_name, sizeof(buffer[slot].name));
+    return write_block(block, buffer);
 }
 
 
+bool add_directory_item(const int parent_inode, const char* name, const int child_inode) {
+    if (!insert_entry(parent_inode, name, child_inode)) return false;
+    dentry_cache_store(parent_inode, name, child_inode);
+    return true;
+}
+
+bool remove_directory_item(const int parent_inode, const char* name) {
+    if (!erase_entry(parent_inode, name)) return false;
+
+    // The name is known to be gone now: keep that as a negative entry
+    dentry_cache_store(parent_inode, name, -1);
+    return true;
+}
+
+bool rename_entry(const int old_dir, const char* old_name, const int new_dir, const char* new_name) {
+    const int inode_id = find_item_in_directory(old_dir, old_name);
+    if (inode_id < 0) return false;
+
+    // Across directories: link in the destination first, so a crash in between
+    // leaves the entry linked twice rather than lost. The write-back caches do
+    // not keep that order by themselves: the destination goes to disk before
+    // the source is touched.
+    if (old_dir != new_dir) {
+        record_block_writes();
+        const bool added = add_directory_item(new_dir, new_name, inode_id);
+
+        struct pseudo_inode dest;
+        read_inode(new_dir, &dest);
+        if (!sync_recorded_writes(new_dir, &dest) || !added) return false;
+        return remove_directory_item(old_dir, old_name);
+    }
+
+    if (!rename_in_place(old_dir, old_name, new_name)) return false;
+    dentry_cache_store(old_dir, old_name, -1);
+    dentry_cache_store(old_dir, new_name, inode_id);
+    return true;
+}
+
+// Visits the occupied slots of every entry block of a directory
+static void visit_items(const struct pseudo_inode* inode, const directory_visitor visit, void* ctx) {
+    struct directory_item buffer[DIR_SLOTS_PER_BLOCK];
+    char name[MAX_FILENAME_LEN + 1];
+    name[MAX_FILENAME_LEN] = '\0';
+
+    const uint32_t blocks = entry_blocks(inode);
+    for (uint32_t b = 0; b < blocks; b++) {
+        uint32_t block;
+        block_map_lookup(inode, b, 1, &block);
+        if (block == FS_INVALID_BLOCK) continue;
+
+        read_block((int)block, buffer);
+        for (int i = 0; i < DIR_SLOTS_PER_BLOCK; i++) {
+            if (buffer[i].inode_id == FS_INVALID_INODE) continue;
+            // A name filling the whole field has no terminator
+            memcpy(name, buffer[i].name, MAX_FILENAME_LEN);
+            visit(ctx, name, (int)buffer[i].inode_id);
+        }
+    }
+}
+
+// for_each_directory_item() visitor for list_directory
+static void print_item(void* ctx, const char* name, const int inode_id) {
+    (void)ctx;
+    printf("  %s (inode %d)\n", name, inode_id);
+}
+
 void list_directory(const int inode_id) {
     // Prints only occupied entries (inode_id != FS_INVALID_INODE).
     struct pseudo_inode inode;
@@ -175,19 +346,20 @@ void list_directory(const int inode_id) {
         return;
     }
 
-    if (inode.direct_blocks[0] == FS_INVALID_BLOCK) {
+    if (directory_block(&inode) < 0) {
         printf("(empty directory)\n");
         return;
     }
 
-    struct directory_item buffer[BLOCK_SIZE / (int)sizeof(struct directory_item)];
-    read_block((int)inode.direct_blocks[0], buffer);
+    visit_items(&inode, print_item, NULL);
+}
 
-    const int items = BLOCK_SIZE / (int)sizeof(struct directory_item);
-    for (int i = 0; i < items; i++) {
-        if (buffer[i].inode_id != FS_INVALID_INODE)
-            printf("  %s (inode %u)\n", buffer[i].name, buffer[i].inode_id);
-    }
+bool for_each_directory_item(const int inode_id, const directory_visitor visit, void* ctx) {
+    struct pseudo_inode inode;
+    if (!read_inode(inode_id, &inode) || !inode.is_directory) return false;
+
+    if (directory_block(&inode) >= 0) visit_items(&inode, visit, ctx);
+    return true;
 }
 
 int find_inode_by_path(const char* path) {
@@ -229,230 +401,587 @@ int create_file(const int parent_inode, const char* name, const bool isDirectory
     inode.file_size = 0;
     inode.amount_of_links = 1;
 
-    for (int i = 0; i < 5; i++) inode.direct_blocks[i] = FS_INVALID_BLOCK;
-    inode.indirect_block = FS_INVALID_BLOCK;
+    block_map_init(&inode);
 
-    if (isDirectory) {
-        inode.direct_blocks[0] = (uint32_t)allocate_free_block();
-        struct directory_item zeroes[BLOCK_SIZE / sizeof(struct directory_item)];
-        memset(zeroes, 0, sizeof(zeroes));
-        for (int i = 0; i < (int)(BLOCK_SIZE / sizeof(struct directory_item)); i++) {
-            zeroes[i].inode_id = FS_INVALID_INODE;
-        }
-        write_block((int)inode.direct_blocks[0], zeroes);
+    if (isDirectory && attach_directory_block(&inode) < 0) {
+        printf("ERROR: No free blocks available to create directory '%s'\n", name);
+        free_inode(inode_id);
+        return -1;
     }
 
     write_inode(inode_id, &inode);
-    add_directory_item(parent_inode, name, inode_id);
+    if (!add_directory_item(parent_inode, name, inode_id)) {
+        // No entry refers to the inode: give back its blocks and slot
+        block_map_release(&inode);
+        free_inode(inode_id);
+        return -1;
+    }
     return inode_id;
 }
 
 
+// Unlinks name (inode_id, already read into inode) from parent_inode and frees it
+static int release_entry(const int parent_inode, const char* name, const int inode_id, struct pseudo_inode* inode) {
+    // Unlink directory entry from parent directory
+    if (!remove_directory_item(parent_inode, name)) {
+        printf("WARNING: Could not remove '%s' from parent directory\n", name);
+        return 1;
+    }
+
+    // Lookups cached under a deleted directory must not outlive it (its inode id gets reused)
+    if (inode->is_directory) dentry_cache_forget_directory(inode_id);
+
+    // Free data blocks and any index/indirect blocks referenced by the inode
+    block_map_release(inode);
+
+    // Finally free the inode slot itself
+    free_inode(inode_id);
+    return 0;
+}
+
 int delete_file(const char* path) {
     // Deletes a file or an empty directory and frees all associated blocks.
-    const int inode_id = find_inode_by_path(path);
+    char name[MAX_FILENAME_LEN];
+    const int parent_inode = resolve_parent(path, name);
+    struct pseudo_inode inode;
+    const int inode_id = parent_inode < 0 ? -1 : lookup_at(parent_inode, name, &inode);
     if (inode_id < 0) {
         printf("ERROR: Path '%s' not found\n", path);
         return 1;
     }
 
-    struct pseudo_inode inode;
-    read_inode(inode_id, &inode);
-
     if (inode.is_directory && !is_directory_empty(inode_id)) {
         printf("Cannot delete non-empty directory (inode %d)\n", inode_id);
         return 2;
     }
 
-    // Split into parent directory and the entry name to unlink from parent
+    return release_entry(parent_inode, name, inode_id, &inode);
+}
+
+
+/* ---------------- Operations relative to a directory ---------------- */
+
+int lookup_path(const char* path, struct pseudo_inode* inode) {
+    const int inode_id = find_inode_by_path(path);
+    if (inode_id >= 0 && inode) read_inode(inode_id, inode);
+    return inode_id;
+}
+
+int resolve_parent(const char* path, char* name) {
     char parent_path[MAX_PATH_LEN];
-    char name[MAX_PATH_LEN];
-    if (!split_path(path, parent_path, name)) {
-        printf("ERROR: Invalid path '%s'\n", path);
-        return 1;
+    if (!split_path(path, parent_path, name) || name[0] == '\0') return -1;
+
+    struct pseudo_inode parent;
+    const int parent_inode = lookup_path(parent_path, &parent);
+    if (parent_inode < 0 || !parent.is_directory) return -1;
+    return parent_inode;
+}
+
+int lookup_at(const int dir_inode, const char* name, struct pseudo_inode* inode) {
+    const int inode_id = find_item_in_directory(dir_inode, name);
+    if (inode_id >= 0 && inode) read_inode(inode_id, inode);
+    return inode_id;
+}
+
+int create_at(const int dir_inode, const char* name, const bool is_directory) {
+    if (find_item_in_directory(dir_inode, name) >= 0) return -1;
+    return create_file(dir_inode, name, is_directory);
+}
+
+int unlink_at(const int dir_inode, const char* name, const bool remove_directory) {
+    struct pseudo_inode inode;
+    const int inode_id = lookup_at(dir_inode, name, &inode);
+    if (inode_id < 0) return 1;
+    if ((inode.is_directory != 0) != remove_directory) return 2;
+    if (remove_directory && !is_directory_empty(inode_id)) return 2;
+
+    return release_entry(dir_inode, name, inode_id, &inode);
+}
+
+int rename_at(const int old_dir, const char* old_name, const int new_dir, const char* new_name) {
+    if (find_item_in_directory(old_dir, old_name) < 0) return 1;
+    if (find_item_in_directory(new_dir, new_name) >= 0) return 2;
+
+    return rename_entry(old_dir, old_name, new_dir, new_name) ? 0 : 3;
+}
+
+
+/* ---------------- File data ---------------- */
+
+/** @brief Bytes file_copy_from_fd() allocates and copies per step. */
+#define COPY_SLICE_SIZE ((uint64_t)16384 * BLOCK_SIZE)
+
+uint64_t max_file_size(void) {
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+    return (sb_disk->features & FS_FEATURE_EXTENTS) ? MAX_FILE_SIZE : MAX_POINTER_FILE_SIZE;
+}
+
+// Resolves a file block through the handle's cached run, asking the map only when it leaves the run
+static uint32_t map_lookup(struct file_handle* fh, const uint32_t logical, const uint32_t max, uint32_t* physical) {
+    if (fh->run_length == 0 || logical < fh->run_logical || logical - fh->run_logical >= fh->run_length) {
+        // Ask for the longest run the map has so the next calls hit the cache
+        fh->run_length = block_map_lookup(&fh->inode, logical, UINT32_MAX - logical, &fh->run_physical);
+        fh->run_logical = logical;
     }
 
-    const int parent_inode = find_inode_by_path(parent_path);
-    if (parent_inode < 0) {
-        printf("ERROR: Parent path '%s' not found\n", parent_path);
-        return 1;
+    const uint32_t skip = logical - fh->run_logical;
+    const uint32_t run = fh->run_length - skip;
+    *physical = fh->run_physical == FS_INVALID_BLOCK ? FS_INVALID_BLOCK : fh->run_physical + skip;
+    return run < max ? run : max;
+}
+
+// Copies [offset, offset + size) of the file into out; holes read as zeros. False on an I/O error
+static bool read_range(struct file_handle* fh, const uint64_t offset, char* out, const uint64_t size) {
+    const uint64_t end = offset + size;
+    uint64_t pos = offset;
+
+    while (pos < end) {
+        const uint32_t logical = (uint32_t)(pos / BLOCK_SIZE);
+        const uint32_t in_block = (uint32_t)(pos % BLOCK_SIZE);
+        char* dst = out + (pos - offset);
+        uint32_t physical;
+
+        if (in_block == 0 && end - pos >= BLOCK_SIZE) {
+            // Whole blocks: one I/O per contiguous run, straight into the caller's buffer
+            const uint64_t whole = (end - pos) / BLOCK_SIZE;
+            const uint32_t run = map_lookup(fh, logical, whole > UINT32_MAX ? UINT32_MAX : (uint32_t)whole, &physical);
+
+            if (physical == FS_INVALID_BLOCK)
+                memset(dst, 0, (size_t)run * BLOCK_SIZE);
+            else if (!read_blocks((int)physical, run, dst))
+                return false;
+            pos += (uint64_t)run * BLOCK_SIZE;
+            continue;
+        }
+
+        // Partial block through a bounce buffer
+        char block_data[BLOCK_SIZE];
+        const uint32_t n = (end - pos < BLOCK_SIZE - in_block) ? (uint32_t)(end - pos) : BLOCK_SIZE - in_block;
+        map_lookup(fh, logical, 1, &physical);
+
+        if (physical == FS_INVALID_BLOCK)
+            memset(block_data, 0, BLOCK_SIZE);
+        else if (!read_block((int)physical, block_data))
+            return false;
+        memcpy(dst, block_data + in_block, n);
+        pos += n;
     }
+    return true;
+}
 
-    // Unlink directory entry from parent directory
-    if (!remove_directory_item(parent_inode, name)) {
-        printf("WARNING: Could not remove '%s' from parent directory\n", name);
-        return 1;
+/* Hands out blocks of a fresh allocation in allocation order */
+struct extent_cursor {
+    const struct block_extent* extents;
+    int index;
+    uint32_t offset;
+};
+
+// Takes up to max blocks from the current run; returns how many, first block in *start
+static uint32_t take_allocated_blocks(struct extent_cursor* cursor, const uint32_t max, uint32_t* start) {
+    const struct block_extent* ext = &cursor->extents[cursor->index];
+    const uint32_t left = ext->length - cursor->offset;
+    const uint32_t n = left < max ? left : max;
+
+    *start = ext->start + cursor->offset;
+    cursor->offset += n;
+    if (cursor->offset == ext->length) {
+        cursor->index++;
+        cursor->offset = 0;
+    }
+    return n;
+}
+
+// Returns the blocks not handed out yet to the free pool
+static void release_remaining_blocks(struct extent_cursor* cursor, const int count) {
+    for (; cursor->index < count; cursor->index++, cursor->offset = 0) {
+        const struct block_extent* ext = &cursor->extents[cursor->index];
+        free_block_run(ext->start + cursor->offset, ext->length - cursor->offset);
     }
+}
 
-    // Free blocks referenced by the inode
-    if (inode.is_directory && inode.direct_blocks[0] != FS_INVALID_BLOCK)
-        free_block((int)inode.direct_blocks[0]);
+// Maps every hole in file blocks [first, end) to freshly allocated blocks, as few runs as possible
+static bool fill_holes(struct file_handle* fh, const uint32_t first, const uint32_t end) {
+    uint32_t missing = 0;
+    for (uint32_t logical = first; logical < end;) {
+        uint32_t physical;
+        const uint32_t run = map_lookup(fh, logical, end - logical, &physical);
+        if (physical == FS_INVALID_BLOCK) missing += run;
+        logical += run;
+    }
+    if (missing == 0) return true;
+    if (missing > get_amount_of_available_blocks()) return false;
 
-    if (!inode.is_directory) {
-        // Free direct blocks
-        for (int i = 0; i < 5; i++) {
-            if (inode.direct_blocks[i] != FS_INVALID_BLOCK)
-                free_block((int)inode.direct_blocks[i]);
-        }
+    struct block_extent* extents = malloc(missing * sizeof(*extents));
+    const int count = extents ? allocate_free_blocks(missing, extents, (int)missing) : -1;
+    if (count < 0) {
+        free(extents);
+        return false;
+    }
 
-        // Free indirect data blocks + indirect block itself
-        if (inode.indirect_block != FS_INVALID_BLOCK) {
-            uint32_t indirect_blocks[BLOCK_SIZE / (int)sizeof(uint32_t)];
-            read_block((int)inode.indirect_block, indirect_blocks);
+    struct extent_cursor cursor = { extents, 0, 0 };
+    for (uint32_t logical = first; logical < end;) {
+        uint32_t physical;
+        const uint32_t run = map_lookup(fh, logical, end - logical, &physical);
+        if (physical != FS_INVALID_BLOCK) {
+            logical += run;
+            continue;
+        }
 
-            const int count = BLOCK_SIZE / (int)sizeof(uint32_t);
-            for (int i = 0; i < count; i++) {
-                if (indirect_blocks[i] != FS_INVALID_BLOCK)
-                    free_block((int)indirect_blocks[i]);
+        for (uint32_t filled = 0; filled < run;) {
+            uint32_t start;
+            const uint32_t n = take_allocated_blocks(&cursor, run - filled, &start);
+            // The cached run may be the hole being filled
+            fh->run_length = 0;
+            if (!block_map_insert(&fh->inode, logical + filled, start, n)) {
+                free_block_run(start, n);
+                release_remaining_blocks(&cursor, count);
+                free(extents);
+                return false;
             }
+            filled += n;
+        }
+        logical += run;
+    }
 
-            free_block((int)inode.indirect_block);
+    free(extents);
+    return true;
+}
+
+static inline bool is_hole(struct file_handle* fh, const uint32_t logical) {
+    uint32_t physical;
+    map_lookup(fh, logical, 1, &physical);
+    return physical == FS_INVALID_BLOCK;
+}
+
+// Read-modify-write of one partial block; bytes past EOF that the write does not cover become zeros. False on an I/O error
+static bool write_partial_block(struct file_handle* fh, const uint64_t pos, const char* src,
+                                const uint32_t n, const bool was_hole) {
+    const uint32_t logical = (uint32_t)(pos / BLOCK_SIZE);
+    const uint32_t in_block = (uint32_t)(pos % BLOCK_SIZE);
+    const uint64_t block_start = (uint64_t)logical * BLOCK_SIZE;
+
+    char block_data[BLOCK_SIZE];
+    uint32_t physical;
+    map_lookup(fh, logical, 1, &physical);
+
+    if (was_hole) {
+        memset(block_data, 0, BLOCK_SIZE);
+    } else {
+        if (!read_block((int)physical, block_data)) return false;
+        if (fh->inode.file_size < block_start + BLOCK_SIZE) {
+            const uint32_t eof = fh->inode.file_size > block_start ? (uint32_t)(fh->inode.file_size - block_start) : 0;
+            memset(block_data + eof, 0, BLOCK_SIZE - eof);
         }
     }
 
-    // Finally free the inode slot itself
-    free_inode(inode_id);
-    return 0;
+    if (n > 0) memcpy(block_data + in_block, src, n);
+    return write_block((int)physical, block_data);
 }
 
+// Zeroes the bytes of a partial last block past EOF before the file grows over them
+static bool clear_eof_tail(struct file_handle* fh) {
+    const uint64_t size = fh->inode.file_size;
+    if (size % BLOCK_SIZE && !is_hole(fh, (uint32_t)(size / BLOCK_SIZE)))
+        return write_partial_block(fh, size, NULL, 0, false);
+    return true;
+}
 
-/**
- * Reads all data blocks of the given inode into a provided buffer.
- *
- * @param inode_id  ID of the inode to read from
- * @param buffer    Pointer to a buffer large enough to hold all data
- * @return          Total number of bytes read into the buffer
- *
- * The function automatically handles:
- *  - Direct data blocks (up to 5)
- *  - Single indirect block (array of block IDs)
- */
-int read_inode_data(int inode_id, void* buffer) {
-    // Reads file contents by following direct blocks and then the indirect block list.
-    struct pseudo_inode inode;
-    read_inode(inode_id, &inode);
+// Frees every block lying wholly past byte size
+static void release_tail(struct file_handle* fh, const uint64_t size) {
+    block_map_truncate(&fh->inode, (uint32_t)((size + BLOCK_SIZE - 1) / BLOCK_SIZE));
+    fh->run_length = 0;
+}
 
-    if (inode.is_directory) {
-        printf("ERROR: inode %d is a directory, not a file\n", inode_id);
-        return -1;
+static bool is_zero_block(const char* data) {
+    // Word loads via memcpy: the caller's buffer need not be aligned
+    for (int i = 0; i < BLOCK_SIZE; i += (int)sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (word != 0) return false;
     }
+    return true;
+}
 
-    int total_read = 0;
-    char block_data[BLOCK_SIZE];
+// A whole block of zeros written over a hole leaves the hole in place
+static inline bool stays_hole(struct file_handle* fh, const uint64_t pos, const uint64_t end, const char* src) {
+    return pos % BLOCK_SIZE == 0 && end - pos >= BLOCK_SIZE && is_hole(fh, (uint32_t)(pos / BLOCK_SIZE)) && is_zero_block(src);
+}
+
+// Writes [offset, offset + size) (size > 0) into the file, allocating what is missing; inode is updated in memory
+static bool write_segment(struct file_handle* fh, const uint64_t offset, const char* data, const uint64_t size) {
+    const uint64_t end = offset + size;
+    const uint32_t first = (uint32_t)(offset / BLOCK_SIZE);
+    const uint32_t last = (uint32_t)((end - 1) / BLOCK_SIZE);
+
+    // Remember which partial blocks are new: their old contents must not be read back
+    const bool head_hole = is_hole(fh, first);
+    const bool tail_hole = is_hole(fh, last);
 
-    // Read direct blocks (up to 5)
-    for (int i = 0; i < 5; i++) {
-        if (inode.direct_blocks[i] == FS_INVALID_BLOCK)
+    if (!fill_holes(fh, first, last + 1)) {
+        printf("ERROR: Not enough free blocks for inode %d\n", fh->inode_id);
+        return false;
+    }
+
+    uint64_t pos = offset;
+    while (pos < end) {
+        const uint32_t logical = (uint32_t)(pos / BLOCK_SIZE);
+        const uint32_t in_block = (uint32_t)(pos % BLOCK_SIZE);
+        const char* src = data + (pos - offset);
+
+        if (in_block == 0 && end - pos >= BLOCK_SIZE) {
+            // Whole blocks: one I/O per contiguous run
+            const uint64_t whole = (end - pos) / BLOCK_SIZE;
+            uint32_t physical;
+            const uint32_t run = map_lookup(fh, logical, whole > UINT32_MAX ? UINT32_MAX : (uint32_t)whole, &physical);
+            if (!write_blocks((int)physical, run, src)) return false;
+            pos += (uint64_t)run * BLOCK_SIZE;
             continue;
+        }
 
-        read_block((int)inode.direct_blocks[i], block_data);
-        memcpy((char*)buffer + total_read, block_data, BLOCK_SIZE);
-        total_read += BLOCK_SIZE;
+        const uint32_t n = (end - pos < BLOCK_SIZE - in_block) ? (uint32_t)(end - pos) : BLOCK_SIZE - in_block;
+        if (!write_partial_block(fh, pos, src, n, logical == first ? head_hole : tail_hole)) return false;
+        pos += n;
     }
 
-    // Read blocks referenced by the single indirect block (if present)
-    if (inode.indirect_block != FS_INVALID_BLOCK) {
-        uint32_t indirect_blocks[BLOCK_SIZE / (int)sizeof(uint32_t)];
-        read_block((int)inode.indirect_block, indirect_blocks);
+    if (end > fh->inode.file_size) fh->inode.file_size = end;
+    return true;
+}
+
+// Writes [offset, offset + size) into the file; whole zero blocks over holes are skipped, not allocated
+static int64_t write_range(struct file_handle* fh, const uint64_t offset, const char* data, uint64_t size) {
+    // The map format bounds the file; the write is cut there
+    const uint64_t limit = (uint64_t)block_map_max_blocks(&fh->inode) * BLOCK_SIZE;
+    if (offset >= limit && size > 0) {
+        printf("ERROR: offset %llu is past the largest size of inode %d\n", (unsigned long long)offset, fh->inode_id);
+        return -1;
+    }
+    if (size > limit - offset) size = limit - offset;
+    if (size == 0) return 0;
 
-        const int count = BLOCK_SIZE / (int)sizeof(uint32_t);
-        for (int i = 0; i < count; i++) {
-            if (indirect_blocks[i] == FS_INVALID_BLOCK)
-                continue;
+    const uint64_t end = offset + size;
 
-            read_block((int)indirect_blocks[i], block_data);
-            memcpy((char*)buffer + total_read, block_data, BLOCK_SIZE);
-            total_read += BLOCK_SIZE;
+    // Extending past a partial last block: clear its stale bytes past the old EOF
+    if (offset > fh->inode.file_size && fh->inode.file_size / BLOCK_SIZE < offset / BLOCK_SIZE && !clear_eof_tail(fh)) return -1;
+
+    uint64_t pos = offset;
+    while (pos < end) {
+        // Data runs up to the next zero block that can stay a hole
+        uint64_t data_end = pos;
+        while (data_end < end && !stays_hole(fh, data_end, end, data + (data_end - offset))) {
+            data_end += BLOCK_SIZE - data_end % BLOCK_SIZE;
+            if (data_end > end) data_end = end;
         }
+        if (data_end > pos && !write_segment(fh, pos, data + (pos - offset), data_end - pos)) return -1;
+
+        pos = data_end;
+        while (pos < end && stays_hole(fh, pos, end, data + (pos - offset))) pos += BLOCK_SIZE;
     }
 
-    // Clamp to the actual file size (last block may be partially used)
-    if (total_read > (int)inode.file_size)
-        total_read = (int)inode.file_size;
+    if (end > fh->inode.file_size) fh->inode.file_size = end;
+    return (int64_t)size;
+}
 
-    return total_read;
+// Loads the inode into a handle; directories cannot be opened as files
+static bool handle_init(struct file_handle* fh, const int inode_id) {
+    memset(fh, 0, sizeof(*fh));
+    fh->inode_id = inode_id;
+    read_inode(inode_id, &fh->inode);
+
+    if (fh->inode.is_directory) {
+        printf("ERROR: inode %d is a directory, not a file\n", inode_id);
+        return false;
+    }
+    return true;
 }
 
+struct file_handle* file_open(const int inode_id) {
+    struct file_handle* fh = malloc(sizeof(*fh));
+    if (!fh) return NULL;
 
-/**
- * Writes data from a buffer into all data blocks of the given inode.
- *
- * @param inode_id  ID of the inode to write into
- * @param buffer    Pointer to data to be written
- * @param size      Number of bytes to write
- * @return          Number of bytes actually written
- *
- * This function automatically:
- *  - Allocates data blocks if needed (direct + indirect)
- *  - Handles single-level indirect addressing
- *  - Updates inode.file_size
- */
-int write_inode_data(int inode_id, const void* buffer, int size) {
-    // Overwrites file contents; allocates blocks as needed and updates inode.file_size.
-    struct pseudo_inode inode;
-    read_inode(inode_id, &inode);
+    if (!handle_init(fh, inode_id)) {
+        free(fh);
+        return NULL;
+    }
+    return fh;
+}
 
-    if (inode.is_directory) {
-        printf("ERROR: inode %d is a directory, not a file\n", inode_id);
-        return -1;
+int64_t file_pread(struct file_handle* fh, void* buffer, uint64_t size, const uint64_t offset) {
+    // Reads stop at EOF
+    if (offset >= fh->inode.file_size) return 0;
+    if (size > fh->inode.file_size - offset) size = fh->inode.file_size - offset;
+
+    return read_range(fh, offset, (char*)buffer, size) ? (int64_t)size : -1;
+}
+
+int64_t file_pwrite(struct file_handle* fh, const void* buffer, const uint64_t size, const uint64_t offset) {
+    const int64_t written = write_range(fh, offset, (const char*)buffer, size);
+
+    // Blocks mapped before a failure stay with the inode
+    fh->dirty = true;
+    return written;
+}
+
+int64_t file_append(struct file_handle* fh, const void* buffer, const uint64_t size) {
+    return file_pwrite(fh, buffer, size, fh->inode.file_size);
+}
+
+bool file_truncate(struct file_handle* fh, const uint64_t new_size) {
+    if (new_size > (uint64_t)block_map_max_blocks(&fh->inode) * BLOCK_SIZE) {
+        printf("ERROR: size %llu is too large for inode %d\n", (unsigned long long)new_size, fh->inode_id);
+        return false;
     }
 
-    int bytes_written = 0;
-    const char* data_ptr = (const char*)buffer;
-    char block_data[BLOCK_SIZE];
+    // Shrinking frees the tail; growing leaves a hole that reads as zeros
+    if (new_size < fh->inode.file_size)
+        release_tail(fh, new_size);
+    else if (new_size > fh->inode.file_size && !clear_eof_tail(fh))
+        return false;
 
-    // Write direct blocks first
-    for (int i = 0; i < 5 && bytes_written < size; i++) {
-        if (inode.direct_blocks[i] == FS_INVALID_BLOCK)
-            inode.direct_blocks[i] = (uint32_t)allocate_free_block();
+    fh->inode.file_size = new_size;
+    fh->dirty = true;
+    return true;
+}
 
-        // Zero-fill the block to avoid leaking old data past EOF
-        memset(block_data, 0, BLOCK_SIZE);
+int64_t file_copy_to_fd(struct file_handle* fh, const int fd) {
+    const uint64_t size = fh->inode.file_size;
 
-        const int chunk = (size - bytes_written > BLOCK_SIZE) ? BLOCK_SIZE : (size - bytes_written);
-        memcpy(block_data, data_ptr + bytes_written, (size_t)chunk);
+    // One kernel copy per mapped run; holes are skipped
+    for (uint64_t pos = 0; pos < size;) {
+        const uint64_t blocks = (size - pos + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        uint32_t physical;
+        const uint32_t run = map_lookup(fh, (uint32_t)(pos / BLOCK_SIZE), blocks > UINT32_MAX ? UINT32_MAX : (uint32_t)blocks, &physical);
+        const uint64_t bytes = ((uint64_t)run * BLOCK_SIZE < size - pos) ? (uint64_t)run * BLOCK_SIZE : size - pos;
 
-        write_block((int)inode.direct_blocks[i], block_data);
-        bytes_written += chunk;
+        if (physical != FS_INVALID_BLOCK && !copy_blocks_to_fd((int)physical, bytes, fd, pos)) return -1;
+        pos += bytes;
     }
+    return (int64_t)size;
+}
 
-    // If data still remains, use the single indirect block
-    if (bytes_written < size) {
-        uint32_t indirect_blocks[BLOCK_SIZE / (int)sizeof(uint32_t)];
+// Copies [pos, end) of fd into the same range of the file, allocating what is missing; pos is block-aligned
+static bool copy_segment_from_fd(struct file_handle* fh, const int fd, uint64_t pos, const uint64_t end) {
+    const uint32_t last = (uint32_t)((end + BLOCK_SIZE - 1) / BLOCK_SIZE);
 
-        if (inode.indirect_block == FS_INVALID_BLOCK) {
-            inode.indirect_block = (uint32_t)allocate_free_block();
+    fh->dirty = true;
+    if (!fill_holes(fh, (uint32_t)(pos / BLOCK_SIZE), last)) {
+        printf("ERROR: Not enough free blocks for inode %d\n", fh->inode_id);
+        return false;
+    }
 
-            // Initialize all pointers to "invalid"
-            for (int k = 0; k < (int)(BLOCK_SIZE / sizeof(uint32_t)); k++)
-                indirect_blocks[k] = FS_INVALID_BLOCK;
+    // The data goes from fd into each mapped run without passing through user space
+    while (pos < end) {
+        const uint32_t logical = (uint32_t)(pos / BLOCK_SIZE);
+        uint32_t physical;
+        const uint32_t run = map_lookup(fh, logical, last - logical, &physical);
+        const uint64_t bytes = ((uint64_t)run * BLOCK_SIZE < end - pos) ? (uint64_t)run * BLOCK_SIZE : end - pos;
 
-            write_block((int)inode.indirect_block, indirect_blocks);
-        } else {
-            read_block((int)inode.indirect_block, indirect_blocks);
-        }
+        if (!copy_blocks_from_fd(fd, pos, (int)physical, bytes)) return false;
+        pos += bytes;
+        if (pos > fh->inode.file_size) fh->inode.file_size = pos;
+    }
+    return true;
+}
 
-        const int indirect_count = BLOCK_SIZE / (int)sizeof(uint32_t);
-        for (int j = 0; j < indirect_count && bytes_written < size; j++) {
-            if (indirect_blocks[j] == FS_INVALID_BLOCK)
-                indirect_blocks[j] = (uint32_t)allocate_free_block();
+int64_t file_copy_from_fd(struct file_handle* fh, const int fd, const uint64_t offset, const uint64_t size) {
+    const uint64_t limit = (uint64_t)block_map_max_blocks(&fh->inode) * BLOCK_SIZE;
+    if (offset % BLOCK_SIZE != 0 || offset > limit || size > limit - offset) return -1;
+    if (size == 0) return 0;
 
-            memset(block_data, 0, BLOCK_SIZE);
+    // Extending past a partial last block: clear its stale bytes past the old EOF
+    if (offset > fh->inode.file_size && !clear_eof_tail(fh)) return -1;
 
-            const int chunk = (size - bytes_written > BLOCK_SIZE) ? BLOCK_SIZE : (size - bytes_written);
-            memcpy(block_data, data_ptr + bytes_written, (size_t)chunk);
+    // Blocks are mapped a slice at a time so the allocation list stays small
+    const uint64_t end = offset + size;
+    for (uint64_t pos = offset; pos < end;) {
+        const uint64_t slice_end = (end - pos > COPY_SLICE_SIZE) ? pos + COPY_SLICE_SIZE : end;
+        if (!copy_segment_from_fd(fh, fd, pos, slice_end)) return -1;
+        pos = slice_end;
+    }
+    return (int64_t)size;
+}
 
-            write_block((int)indirect_blocks[j], block_data);
-            bytes_written += chunk;
-        }
+bool file_close(struct file_handle* fh) {
+    if (!fh) return true;
 
-        // Persist updated indirect pointer table
-        write_block((int)inode.indirect_block, indirect_blocks);
+    const bool ok = !fh->dirty || write_inode(fh->inode_id, &fh->inode);
+    free(fh);
+    return ok;
+}
+
+bool truncate_inode(const int inode_id, const uint64_t new_size) {
+    struct file_handle fh;
+    if (!handle_init(&fh, inode_id)) return false;
+    if (!file_truncate(&fh, new_size)) return false;
+    return write_inode(inode_id, &fh.inode);
+}
+
+int64_t read_inode_range(const int inode_id, const uint64_t offset, void* buffer, const uint64_t size) {
+    struct file_handle fh;
+    if (!handle_init(&fh, inode_id)) return -1;
+    return file_pread(&fh, buffer, size, offset);
+}
+
+int64_t write_inode_range(const int inode_id, const uint64_t offset, const void* buffer, const uint64_t size) {
+    struct file_handle fh;
+    if (!handle_init(&fh, inode_id)) return -1;
+
+    const int64_t written = file_pwrite(&fh, buffer, size, offset);
+    write_inode(inode_id, &fh.inode);
+    return written;
+}
+
+/**
+ * Reads all data blocks of the given inode into a provided buffer.
+ *
+ * @param inode_id  ID of the inode to read from
+ * @param buffer    Pointer to a buffer large enough to hold all data
+ * @return          Total number of bytes read into the buffer
+ *
+ * Follows the inode's block map (pointer map or extent tree) run by run:
+ *  - Each physically contiguous run is read with one I/O straight into the buffer
+ *  - Unmapped blocks read as zeros
+ */
+int read_inode_data(int inode_id, void* buffer) {
+    struct file_handle fh;
+    if (!handle_init(&fh, inode_id)) return -1;
+
+    if (fh.inode.file_size > (uint64_t)INT32_MAX) {
+        printf("ERROR: inode %d is too large to read at once\n", inode_id);
+        return -1;
     }
 
-    // Update inode metadata after data blocks are written
-    inode.file_size = (uint32_t)bytes_written;
-    write_inode(inode_id, &inode);
+    if (!read_range(&fh, 0, (char*)buffer, fh.inode.file_size)) return -1;
+    return (int)fh.inode.file_size;
+}
+
+/**
+ * Writes data from a buffer into all data blocks of the given inode.
+ *
+ * @param inode_id  ID of the inode to write into
+ * @param buffer    Pointer to data to be written
+ * @param size      Number of bytes to write
+ * @return          Number of bytes actually written
+ *
+ * This function automatically:
+ *  - Allocates all missing data blocks in one request, so a new file lands
+ *    in as few contiguous runs as possible, and maps them into the inode
+ *  - Writes each contiguous run with a single I/O
+ *  - Frees blocks left past the new end by longer old content
+ *  - Updates inode.file_size
+ */
+int write_inode_data(int inode_id, const void* buffer, int size) {
+    // Overwrites file contents; allocates blocks as needed and updates inode.file_size.
+    struct file_handle fh;
+    if (!handle_init(&fh, inode_id)) return -1;
+    if (size < 0) return -1;
+
+    // Old content is discarded: the whole file counts as past EOF while it is rewritten
+    fh.inode.file_size = 0;
+    const int64_t written = file_pwrite(&fh, buffer, (uint64_t)size, 0);
+
+    // Blocks of the old content past the new end are freed, not kept until delete
+    if (written >= 0) release_tail(&fh, fh.inode.file_size);
 
-    return bytes_written;
+    write_inode(inode_id, &fh.inode);
+    return (int)written;
 }
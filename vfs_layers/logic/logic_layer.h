@@ -18,11 +18,19 @@
 #define MAX_PATH_LEN 256
 
 /**
- * @brief Maximum file size supported by the current inode addressing scheme.
+ * @brief Maximum file size of a pointer-mapped inode (images without FS_FEATURE_EXTENTS).
  *
  * Computed as: 5 direct blocks + (BLOCK_SIZE / sizeof(uint32_t)) indirect blocks.
  */
-#define MAX_FILE_SIZE ((5 + (BLOCK_SIZE / sizeof(uint32_t))) * BLOCK_SIZE)
+#define MAX_POINTER_FILE_SIZE ((5 + (BLOCK_SIZE / sizeof(uint32_t))) * BLOCK_SIZE)
+
+/**
+ * @brief Maximum file size of an extent-mapped inode.
+ *
+ * File block numbers are 32-bit, so a file spans at most UINT32_MAX blocks
+ * (16 TiB with 4 KiB blocks). The container size is the practical limit.
+ */
+#define MAX_FILE_SIZE ((uint64_t)UINT32_MAX * BLOCK_SIZE)
 
 /**
  * @brief Initializes logic layer state.
@@ -75,6 +83,24 @@ bool add_directory_item(int parent_inode, const char* name, int child_inode);
  */
 bool remove_directory_item(int parent_inode, const char* name);
 
+/**
+ * @brief Moves a directory entry to a new name and/or directory.
+ *
+ * Within one directory the name field is rewritten in place: one block
+ * write, so the entry is never missing or linked twice. Across directories
+ * the entry is linked in new_dir first and unlinked from old_dir second,
+ * with the blocks, bitmap bits and inode that the link touched written
+ * through the caches in between (sync_recorded_writes()).
+ * new_name must not exist in new_dir.
+ *
+ * @param old_dir Directory holding the entry.
+ * @param old_name Current name.
+ * @param new_dir Destination directory.
+ * @param new_name New name (< MAX_FILENAME_LEN).
+ * @return true on success, false if the entry is missing or a directory could not be updated.
+ */
+bool rename_entry(int old_dir, const char* old_name, int new_dir, const char* new_name);
+
 /**
  * @brief Finds a child entry by name inside a directory inode.
  *
@@ -91,6 +117,27 @@ int find_item_in_directory(int parent_inode, const char* name);
  */
 void list_directory(int inode_id);
 
+/**
+ * @brief Visitor called by for_each_directory_item() for every occupied entry.
+ *
+ * @param ctx Caller context.
+ * @param name Entry name, NUL-terminated.
+ * @param inode_id Child inode id.
+ */
+typedef void (*directory_visitor)(void* ctx, const char* name, int inode_id);
+
+/**
+ * @brief Calls visit for every entry of a directory, in slot order (what list_directory() prints).
+ *
+ * The visitor must not change the directory.
+ *
+ * @param inode_id Directory inode id.
+ * @param visit Visitor.
+ * @param ctx Passed through to visit.
+ * @return false if inode_id is not a directory.
+ */
+bool for_each_directory_item(int inode_id, directory_visitor visit, void* ctx);
+
 /**
  * @brief Creates a file or directory and links it into the parent directory.
  *
@@ -109,6 +156,71 @@ int create_file(int parent_inode, const char* name, bool isDirectory);
  */
 int delete_file(const char* path);
 
+/**
+ * @brief Resolves a path and reads its inode in one walk.
+ *
+ * @param path Absolute path.
+ * @param inode Output: the inode, may be NULL.
+ * @return Inode id, or -1 if not found.
+ */
+int lookup_path(const char* path, struct pseudo_inode* inode);
+
+/**
+ * @brief Resolves the directory that holds the last component of a path.
+ *
+ * This is the only path walk a command needs: the entry itself is then
+ * reached with lookup_at(), create_at(), unlink_at() or rename_at().
+ *
+ * @param path Absolute path.
+ * @param name Output buffer for the last component (MAX_FILENAME_LEN).
+ * @return Parent directory inode id, or -1 if the path is invalid, ends in
+ *         '/' or its parent is missing or not a directory.
+ */
+int resolve_parent(const char* path, char* name);
+
+/**
+ * @brief Looks up an entry of a directory and optionally reads its inode.
+ *
+ * @param dir_inode Directory inode id.
+ * @param name Entry name.
+ * @param inode Output: the entry's inode, may be NULL.
+ * @return Inode id of the entry, or -1 if not found.
+ */
+int lookup_at(int dir_inode, const char* name, struct pseudo_inode* inode);
+
+/**
+ * @brief Creates a file or directory in a directory unless the name is taken.
+ *
+ * @param dir_inode Parent directory inode id.
+ * @param name New entry name (< MAX_FILENAME_LEN).
+ * @param is_directory true to create a directory.
+ * @return New inode id, or -1 if the name exists or creation failed.
+ */
+int create_at(int dir_inode, const char* name, bool is_directory);
+
+/**
+ * @brief Removes an entry of a directory and frees its inode and blocks.
+ *
+ * @param dir_inode Parent directory inode id.
+ * @param name Entry name.
+ * @param remove_directory true to remove an empty directory, false for a file.
+ * @return 0 on success, 1 if not found, 2 if the entry is of the other kind
+ *         or a non-empty directory.
+ */
+int unlink_at(int dir_inode, const char* name, bool remove_directory);
+
+/**
+ * @brief Moves an entry to another name and/or directory.
+ *
+ * @param old_dir Directory holding the entry.
+ * @param old_name Current name.
+ * @param new_dir Destination directory.
+ * @param new_name New name (< MAX_FILENAME_LEN).
+ * @return 0 on success, 1 if the entry is missing, 2 if new_name exists in
+ *         new_dir, 3 if the directories could not be updated.
+ */
+int rename_at(int old_dir, const char* old_name, int new_dir, const char* new_name);
+
 /**
  * @brief Splits a path into parent directory path and last component name.
  *
@@ -129,12 +241,187 @@ bool split_path(const char* path, char* parent, char* name);
  */
 bool is_directory_empty(int inode_id);
 
+/**
+ * @brief Largest file that can be created on the mounted image.
+ *
+ * @return MAX_FILE_SIZE with FS_FEATURE_EXTENTS, MAX_POINTER_FILE_SIZE otherwise.
+ */
+uint64_t max_file_size(void);
+
+/**
+ * @brief Sets the size of a file, freeing blocks past a smaller size.
+ *
+ * See file_truncate().
+ *
+ * @param inode_id File inode id.
+ * @param new_size New file size in bytes.
+ * @return true on success, false on error.
+ */
+bool truncate_inode(int inode_id, uint64_t new_size);
+
+/**
+ * @brief Reads up to size bytes of a file starting at byte offset.
+ *
+ * Only the blocks covering the range are mapped and read; whole-block runs
+ * go straight into buffer with one I/O each. Holes read as zeros.
+ *
+ * @param inode_id File inode id.
+ * @param offset Byte offset to start at.
+ * @param buffer Output buffer of at least size bytes.
+ * @param size Number of bytes requested.
+ * @return Bytes read (short at EOF, 0 past it), or -1 on error.
+ */
+int64_t read_inode_range(int inode_id, uint64_t offset, void* buffer, uint64_t size);
+
+/**
+ * @brief Writes size bytes into a file starting at byte offset.
+ *
+ * Allocates blocks missing in the range, read-modify-writes only the
+ * partial first and last blocks, and grows file_size if the write ends past
+ * EOF. Content outside the range is left untouched.
+ *
+ * @param inode_id File inode id.
+ * @param offset Byte offset to start at.
+ * @param buffer Input data.
+ * @param size Number of bytes to write.
+ * @return Bytes written (short if the map format cannot address the whole
+ *         range), or -1 on error (e.g. no free blocks).
+ */
+int64_t write_inode_range(int inode_id, uint64_t offset, const void* buffer, uint64_t size);
+
+/**
+ * @brief Open file: the inode and the last block map run it resolved.
+ *
+ * Repeated reads and writes through a handle neither re-read the inode nor
+ * walk the block map again while they stay inside the cached run, which is
+ * what makes sequential chunked I/O cheap on deep extent trees.
+ */
+struct file_handle {
+    /** @brief Inode id of the open file. */
+    int inode_id;
+    /** @brief Cached inode, including the root of its block map. */
+    struct pseudo_inode inode;
+    /** @brief The cached inode differs from the inode table. */
+    bool dirty;
+    /** @brief First file block of the cached run. */
+    uint32_t run_logical;
+    /** @brief First data block of the cached run, FS_INVALID_BLOCK for a hole. */
+    uint32_t run_physical;
+    /** @brief Length of the cached run in blocks, 0 if none is cached. */
+    uint32_t run_length;
+};
+
+/**
+ * @brief Opens a regular file for offset-based I/O.
+ *
+ * @param inode_id File inode id.
+ * @return New handle, or NULL if the inode is a directory or memory ran out.
+ */
+struct file_handle* file_open(int inode_id);
+
+/**
+ * @brief Reads up to size bytes at offset through a handle.
+ *
+ * Same semantics as read_inode_range().
+ *
+ * @param fh Open handle.
+ * @param buffer Output buffer of at least size bytes.
+ * @param size Number of bytes requested.
+ * @param offset Byte offset to start at.
+ * @return Bytes read (short at EOF, 0 past it), or -1 on error.
+ */
+int64_t file_pread(struct file_handle* fh, void* buffer, uint64_t size, uint64_t offset);
+
+/**
+ * @brief Writes size bytes at offset through a handle.
+ *
+ * Same semantics as write_inode_range(), but the inode is only written back
+ * by file_close().
+ *
+ * @param fh Open handle.
+ * @param buffer Input data.
+ * @param size Number of bytes to write.
+ * @param offset Byte offset to start at.
+ * @return Bytes written, or -1 on error.
+ */
+int64_t file_pwrite(struct file_handle* fh, const void* buffer, uint64_t size, uint64_t offset);
+
+/**
+ * @brief Appends size bytes at the end of the file.
+ *
+ * Only the partially used last block is read-modify-written; everything
+ * past it goes into newly allocated blocks. file_size is updated in the
+ * handle and reaches the inode table once, on file_close().
+ *
+ * @param fh Open handle.
+ * @param buffer Input data.
+ * @param size Number of bytes to append.
+ * @return Bytes appended, or -1 on error.
+ */
+int64_t file_append(struct file_handle* fh, const void* buffer, uint64_t size);
+
+/**
+ * @brief Sets the file size through a handle.
+ *
+ * Shrinking frees every data block past the new end, and index or indirect
+ * blocks that no longer map anything. Growing allocates nothing: the new
+ * range is a hole that reads as zeros.
+ *
+ * @param fh Open handle.
+ * @param new_size New file size in bytes.
+ * @return true on success, false if the map format cannot address new_size
+ *         or the partial last block cannot be cleared.
+ */
+bool file_truncate(struct file_handle* fh, uint64_t new_size);
+
+/**
+ * @brief Copies the whole file to a host descriptor at the same offsets.
+ *
+ * Each mapped run is handed to the kernel (copy_file_range()/sendfile(),
+ * with a buffered fallback), so the data never passes through user space.
+ * Holes are skipped: the caller sizes fd to file_size first so they read
+ * back as zeros.
+ *
+ * @param fh Open handle.
+ * @param fd Host descriptor opened for writing.
+ * @return Bytes covered (file_size), or -1 on I/O error.
+ */
+int64_t file_copy_to_fd(struct file_handle* fh, int fd);
+
+/**
+ * @brief Copies [offset, offset + size) of a host descriptor to the same range of the file.
+ *
+ * Missing blocks are allocated and mapped first, then filled by the kernel
+ * run by run without passing through user space. Zero blocks are stored
+ * as written; leave host holes out of the range to keep them holes.
+ *
+ * @param fh Open handle.
+ * @param fd Host descriptor opened for reading.
+ * @param offset Byte offset in both fd and the file; must be a multiple of BLOCK_SIZE.
+ * @param size Number of bytes to copy.
+ * @return Bytes copied, or -1 on error (misaligned offset, range past the
+ *         map limit, no free blocks, I/O error).
+ */
+int64_t file_copy_from_fd(struct file_handle* fh, int fd, uint64_t offset, uint64_t size);
+
+/**
+ * @brief Writes the inode back if it changed and frees the handle.
+ *
+ * @param fh Handle to close; NULL is ignored.
+ * @return true on success, false if the inode could not be written.
+ */
+bool file_close(struct file_handle* fh);
+
 /**
  * @brief Reads file content of an inode into the provided buffer.
  *
+ * Contiguous runs of the block map are read with one I/O each; holes read
+ * as zeros.
+ *
  * @param inode_id File inode id.
- * @param buffer Output buffer, must be large enough (typically MAX_FILE_SIZE).
- * @return Number of bytes read, or -1 on error.
+ * @param buffer Output buffer of at least inode.file_size bytes.
+ * @return Number of bytes read, or -1 on error (also for files over 2 GiB;
+ *         use read_inode_range() for those).
  */
 int read_inode_data(int inode_id, void* buffer);
 
@@ -142,6 +429,7 @@ int read_inode_data(int inode_id, void* buffer);
  * @brief Writes data into a file inode, allocating blocks if needed.
  *
  * This overwrites previous file content and updates inode.file_size.
+ * Missing blocks are allocated in one request and written run by run.
  *
  * @param inode_id File inode id.
  * @param buffer Input data.
@@ -0,0 +1,276 @@
+#include "bitmap.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Loads bitmap word w; bytes past the end of the bitmap read as used
+static inline uint64_t load_word(const uint8_t* bitmap, const uint64_t nbits, const uint64_t w) {
+    const uint64_t bytes = (nbits + 7) / 8;
+    const uint64_t off = w * 8;
+    uint64_t word = UINT64_MAX;
+
+    if (off + 8 <= bytes) {
+        memcpy(&word, bitmap + off, 8);
+    } else if (off < bytes) {
+        uint8_t tail[8];
+        memset(tail, 0xFF, sizeof(tail));
+        memcpy(tail, bitmap + off, (size_t)(bytes - off));
+        memcpy(&word, tail, 8);
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+/*
+ * On x86-64 Linux, build a POPCNT clone next to the generic one; the loader
+ * picks the right one for the host CPU. Elsewhere the builtin is used as is.
+ */
+#if defined(__x86_64__) && defined(__linux__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define POPCOUNT_CLONES __attribute__((target_clones("popcnt", "default")))
+#endif
+#endif
+#ifndef POPCOUNT_CLONES
+#define POPCOUNT_CLONES
+#endif
+
+// Population count over whole 64-bit words; the loop is independent per word and vectorizes
+POPCOUNT_CLONES
+static uint64_t popcount_words(const uint8_t* bytes, const uint64_t words) {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, bytes + i * 8, 8);
+        total += (uint64_t)__builtin_popcountll(word);
+    }
+    return total;
+}
+
+uint64_t bitmap_count_set(const uint8_t* bitmap, const uint64_t nbits) {
+    const uint64_t words = nbits / BITMAP_WORD_BITS;
+
+    // Byte order does not matter for a population count of whole words
+    uint64_t total = popcount_words(bitmap, words);
+
+    // Scalar tail: remaining bits of the last, partial word
+    for (uint64_t i = words * BITMAP_WORD_BITS; i < nbits; i++) {
+        if (bitmap[i / 8] & (1u << (i % 8))) total++;
+    }
+    return total;
+}
+
+int64_t bitmap_find_clear(const uint8_t* bitmap, const uint64_t nbits, const uint64_t start, uint64_t end) {
+    if (end > nbits) end = nbits;
+    if (start >= end) return -1;
+
+    uint64_t w = start / BITMAP_WORD_BITS;
+    const uint64_t last = (end - 1) / BITMAP_WORD_BITS;
+
+    // Ignore bits below start in the first word
+    uint64_t free_bits = ~load_word(bitmap, nbits, w) & (UINT64_MAX << (start % BITMAP_WORD_BITS));
+
+    for (;;) {
+        if (free_bits) {
+            const uint64_t idx = w * BITMAP_WORD_BITS + (uint64_t)__builtin_ctzll(free_bits);
+            return idx < end ? (int64_t)idx : -1;
+        }
+        if (++w > last) return -1;
+        free_bits = ~load_word(bitmap, nbits, w);
+    }
+}
+
+int64_t bitmap_find_clear_from(const uint8_t* bitmap, const uint64_t nbits, uint64_t hint) {
+    if (hint >= nbits) hint = 0;
+
+    const int64_t idx = bitmap_find_clear(bitmap, nbits, hint, nbits);
+    if (idx >= 0 || hint == 0) return idx;
+    return bitmap_find_clear(bitmap, nbits, 0, hint);
+}
+
+uint64_t bitmap_clear_run(const uint8_t* bitmap, const uint64_t nbits, const uint64_t start, const uint64_t max) {
+    if (start >= nbits) return 0;
+    const uint64_t end = (nbits - start > max) ? start + max : nbits;
+
+    uint64_t pos = start;
+    while (pos < end) {
+        // Used bits of the current word at or above pos; the lowest one ends the run
+        const uint64_t used = load_word(bitmap, nbits, pos / BITMAP_WORD_BITS) >> (pos % BITMAP_WORD_BITS);
+        if (used) {
+            pos += (uint64_t)__builtin_ctzll(used);
+            break;
+        }
+        pos = (pos / BITMAP_WORD_BITS + 1) * BITMAP_WORD_BITS;
+    }
+    return (pos < end ? pos : end) - start;
+}
+
+/* ---------------- Summary levels ---------------- */
+
+// Free bits of bitmap word w, with bits at or beyond nbits masked out
+static inline uint64_t free_word(const uint8_t* bitmap, const uint64_t nbits, const uint64_t w) {
+    uint64_t bits = ~load_word(bitmap, nbits, w);
+    const uint64_t end = (w + 1) * BITMAP_WORD_BITS;
+    if (end > nbits) {
+        const uint64_t valid = nbits - w * BITMAP_WORD_BITS;
+        bits &= (valid >= BITMAP_WORD_BITS) ? UINT64_MAX : ((UINT64_C(1) << valid) - 1);
+    }
+    return bits;
+}
+
+static inline void assign_bit(uint64_t* words, const uint64_t bit, const bool value) {
+    if (value) words[bit / BITMAP_WORD_BITS] |= UINT64_C(1) << (bit % BITMAP_WORD_BITS);
+    else words[bit / BITMAP_WORD_BITS] &= ~(UINT64_C(1) << (bit % BITMAP_WORD_BITS));
+}
+
+static inline bool test_word_bit(const uint64_t* words, const uint64_t bit) {
+    return (words[bit / BITMAP_WORD_BITS] >> (bit % BITMAP_WORD_BITS)) & 1;
+}
+
+// Word w of level lvl - 1 has no free bit left: clear its bit in level lvl, and upwards while words empty
+static void propagate_full(struct bitmap_summary* s, int lvl, uint64_t w) {
+    for (; lvl < s->levels; lvl++) {
+        assign_bit(s->level[lvl], w, false);
+        w /= BITMAP_WORD_BITS;
+        if (s->level[lvl][w]) break;
+    }
+}
+
+// Computes level-0 word w from the 64 bitmap words it covers, the first time it is needed
+static void build_region(struct bitmap_summary* s, const uint8_t* bitmap, const uint64_t w) {
+    if (test_word_bit(s->built, w)) return;
+    assign_bit(s->built, w, true);
+
+    uint64_t word = 0;
+    const uint64_t first = w * BITMAP_WORD_BITS;
+    for (uint64_t i = 0; i < BITMAP_WORD_BITS && first + i < s->level_bits[0]; i++) {
+        if (free_word(bitmap, s->nbits, first + i)) word |= UINT64_C(1) << i;
+    }
+
+    // It started out as "all may be free", and so did the levels above
+    s->level[0][w] = word;
+    if (word == 0) propagate_full(s, 1, w);
+}
+
+// Word w of level lvl; level -1 stands for the free bits of the bitmap itself
+static inline uint64_t level_word(struct bitmap_summary* s, const uint8_t* bitmap, const int lvl, const uint64_t w) {
+    if (lvl < 0) return free_word(bitmap, s->nbits, w);
+    if (lvl == 0) build_region(s, bitmap, w);
+    return s->level[lvl][w];
+}
+
+static inline uint64_t level_size(const struct bitmap_summary* s, const int lvl) {
+    return lvl < 0 ? s->nbits : s->level_bits[lvl];
+}
+
+// First set bit at or after pos in level lvl, using the levels above to skip empty words
+static int64_t find_set(struct bitmap_summary* s, const uint8_t* bitmap, const int lvl, const uint64_t pos) {
+    if (pos >= level_size(s, lvl)) return -1;
+
+    uint64_t w = pos / BITMAP_WORD_BITS;
+    const uint64_t rest = level_word(s, bitmap, lvl, w) & (UINT64_MAX << (pos % BITMAP_WORD_BITS));
+    if (rest) return (int64_t)(w * BITMAP_WORD_BITS + (uint64_t)__builtin_ctzll(rest));
+
+    // The top level is a single word, so nothing is left beyond it
+    if (lvl + 1 >= s->levels) return -1;
+
+    for (;;) {
+        const int64_t next = find_set(s, bitmap, lvl + 1, w + 1);
+        if (next < 0) return -1;
+
+        const uint64_t word = level_word(s, bitmap, lvl, (uint64_t)next);
+        if (word) return next * BITMAP_WORD_BITS + __builtin_ctzll(word);
+
+        // A region scanned just now turned out full; the levels above have been corrected
+        w = (uint64_t)next;
+    }
+}
+
+// Sets the first bits bits of words, leaving the rest of the last word clear
+static void fill_ones(uint64_t* words, const uint64_t bits) {
+    const uint64_t full = bits / BITMAP_WORD_BITS;
+    for (uint64_t i = 0; i < full; i++) words[i] = UINT64_MAX;
+    if (bits % BITMAP_WORD_BITS) words[full] = (UINT64_C(1) << (bits % BITMAP_WORD_BITS)) - 1;
+}
+
+void bitmap_summary_free(struct bitmap_summary* summary) {
+    for (int i = 0; i < BITMAP_SUMMARY_MAX_LEVELS; i++) {
+        free(summary->level[i]);
+        summary->level[i] = NULL;
+        summary->level_bits[i] = 0;
+    }
+    free(summary->built);
+    summary->built = NULL;
+    summary->levels = 0;
+    summary->nbits = 0;
+}
+
+int bitmap_summary_build(struct bitmap_summary* summary, const uint8_t* bitmap, const uint64_t nbits) {
+    (void)bitmap; // Read later, one region at a time
+    bitmap_summary_free(summary);
+    summary->nbits = nbits;
+
+    // Each level has one bit per word of the level below, until one word is enough
+    uint64_t below = nbits;
+    do {
+        const uint64_t bits = (below + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+        const uint64_t words = (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+        const int lvl = summary->levels;
+
+        if (lvl >= BITMAP_SUMMARY_MAX_LEVELS) {
+            bitmap_summary_free(summary);
+            return -1;
+        }
+
+        summary->level[lvl] = calloc(words ? words : 1, sizeof(uint64_t));
+        if (!summary->level[lvl]) {
+            bitmap_summary_free(summary);
+            return -1;
+        }
+        summary->level_bits[lvl] = bits;
+        summary->levels++;
+
+        // Nothing scanned yet: every word below may have free bits
+        fill_ones(summary->level[lvl], bits);
+        below = bits;
+    } while (below > BITMAP_WORD_BITS);
+
+    const uint64_t regions = summary->level_bits[0];
+    summary->built = calloc((regions + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS + 1, sizeof(uint64_t));
+    if (!summary->built) {
+        bitmap_summary_free(summary);
+        return -1;
+    }
+    return 0;
+}
+
+void bitmap_summary_update(struct bitmap_summary* summary, const uint8_t* bitmap, const uint64_t bit) {
+    uint64_t w = bit / BITMAP_WORD_BITS;
+
+    // An unscanned region already claims free space and is computed exactly when first searched
+    if (!test_word_bit(summary->built, w / BITMAP_WORD_BITS)) return;
+
+    // Propagate upwards only while a word's "has free" state actually flips
+    bool has_free = free_word(bitmap, summary->nbits, w) != 0;
+
+    for (int lvl = 0; lvl < summary->levels; lvl++) {
+        uint64_t* words = summary->level[lvl];
+        const bool before = words[w / BITMAP_WORD_BITS] != 0;
+        assign_bit(words, w, has_free);
+
+        w /= BITMAP_WORD_BITS;
+        has_free = words[w] != 0;
+        if (has_free == before) break;
+    }
+}
+
+int64_t bitmap_summary_find_clear_from(struct bitmap_summary* summary, const uint8_t* bitmap, uint64_t hint) {
+    if (hint >= summary->nbits) hint = 0;
+
+    const int64_t idx = find_set(summary, bitmap, -1, hint);
+    if (idx >= 0 || hint == 0) return idx;
+    return find_set(summary, bitmap, -1, 0);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * @brief Word-at-a-time helpers over allocation bitmaps.
+ *
+ * Bitmaps store bit i in byte i / 8 at position i % 8 (least significant
+ * bit first), which is exactly the bit order of a little-endian 64-bit load.
+ * Bits at or beyond nbits are treated as used.
+ */
+
+/**
+ * @brief Number of bits held in one bitmap word.
+ */
+#define BITMAP_WORD_BITS 64
+
+/**
+ * @brief Finds the first clear (free) bit in [start, end).
+ *
+ * Skips fully used 64-bit words and locates the free bit with
+ * count-trailing-zeros.
+ *
+ * @param bitmap Allocation bitmap.
+ * @param nbits Number of valid bits in the bitmap.
+ * @param start First bit index to consider.
+ * @param end One past the last bit index to consider (clamped to nbits).
+ * @return Index of the first clear bit, or -1 if every bit in the range is set.
+ */
+int64_t bitmap_find_clear(const uint8_t* bitmap, uint64_t nbits, uint64_t start, uint64_t end);
+
+/**
+ * @brief Next-fit search: first clear bit at or after hint, wrapping to 0.
+ *
+ * @param bitmap Allocation bitmap.
+ * @param nbits Number of valid bits in the bitmap.
+ * @param hint Bit index where the search starts (values >= nbits start at 0).
+ * @return Index of a clear bit, or -1 if the bitmap is full.
+ */
+int64_t bitmap_find_clear_from(const uint8_t* bitmap, uint64_t nbits, uint64_t hint);
+
+/**
+ * @brief Length of the run of clear bits starting at start.
+ *
+ * Whole free words are skipped at once; the run ends at the first set bit,
+ * at nbits, or after max bits, whichever comes first.
+ *
+ * @param bitmap Allocation bitmap.
+ * @param nbits Number of valid bits in the bitmap.
+ * @param start First bit of the run.
+ * @param max Upper bound on the returned length.
+ * @return Number of consecutive clear bits (0 if start itself is set).
+ */
+uint64_t bitmap_clear_run(const uint8_t* bitmap, uint64_t nbits, uint64_t start, uint64_t max);
+
+/**
+ * @brief Counts set (used) bits among the first nbits bits.
+ *
+ * Whole 64-bit words are counted with a hardware popcount where the CPU
+ * supports it (selected at load time), the partial last word with a mask.
+ *
+ * @param bitmap Allocation bitmap.
+ * @param nbits Number of valid bits in the bitmap.
+ * @return Number of set bits.
+ */
+uint64_t bitmap_count_set(const uint8_t* bitmap, uint64_t nbits);
+
+/**
+ * @brief Maximum number of summary levels above a bitmap.
+ *
+ * Each level shrinks the previous one 64-fold, so six levels cover 2^42 bits.
+ */
+#define BITMAP_SUMMARY_MAX_LEVELS 6
+
+/**
+ * @brief Hierarchical "has free space" index over an allocation bitmap.
+ *
+ * Level 0 holds one bit per 64-bit bitmap word (set if the word has a clear
+ * bit), level 1 one bit per level-0 word (set if that 4096-bit region has a
+ * free entry), and so on until a level fits into a single word. A search
+ * touches one word per level, so finding free space is O(log n) no matter
+ * how full the bitmap is.
+ *
+ * Level-0 words are filled in lazily: until a search first reaches one, it
+ * claims that all 64 bitmap words it covers may have free bits, and the
+ * levels above agree. Building a summary therefore never reads the bitmap.
+ */
+struct bitmap_summary {
+    /** @brief Number of valid bits in the underlying bitmap. */
+    uint64_t nbits;
+    /** @brief Number of summary levels in use. */
+    int levels;
+    /** @brief Number of bits in each level. */
+    uint64_t level_bits[BITMAP_SUMMARY_MAX_LEVELS];
+    /** @brief Bit arrays of each level, lowest (finest) level first. */
+    uint64_t* level[BITMAP_SUMMARY_MAX_LEVELS];
+    /** @brief One bit per level-0 word, set once that word has been computed from the bitmap. */
+    uint64_t* built;
+};
+
+/**
+ * @brief Sets up the summary levels for a bitmap.
+ *
+ * Any previous contents of summary are released first. Only the summary
+ * itself (about nbits / 4096 words) is initialized; the bitmap is scanned
+ * region by region as searches reach it.
+ *
+ * @param summary Summary to (re)build.
+ * @param bitmap Allocation bitmap.
+ * @param nbits Number of valid bits in the bitmap.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int bitmap_summary_build(struct bitmap_summary* summary, const uint8_t* bitmap, uint64_t nbits);
+
+/**
+ * @brief Releases memory held by a summary.
+ *
+ * @param summary Summary to release; left empty and safe to rebuild.
+ */
+void bitmap_summary_free(struct bitmap_summary* summary);
+
+/**
+ * @brief Refreshes the summary after a bitmap bit was set or cleared.
+ *
+ * @param summary Summary of bitmap.
+ * @param bitmap Allocation bitmap (already modified).
+ * @param bit Index of the bit that changed.
+ */
+void bitmap_summary_update(struct bitmap_summary* summary, const uint8_t* bitmap, uint64_t bit);
+
+/**
+ * @brief Next-fit search through the summary: first clear bit at or after hint, wrapping to 0.
+ *
+ * Computes the level-0 words it passes for the first time.
+ *
+ * @param summary Summary of bitmap.
+ * @param bitmap Allocation bitmap.
+ * @param hint Bit index where the search starts (values >= nbits start at 0).
+ * @return Index of a clear bit, or -1 if the bitmap is full.
+ */
+int64_t bitmap_summary_find_clear_from(struct bitmap_summary* summary, const uint8_t* bitmap, uint64_t hint);
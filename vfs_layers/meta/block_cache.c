@@ -0,0 +1,320 @@
+#include "block_cache.h"
+#include "../disk/disk_layer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* One cache slot; block data lives in the shared slab at the same index */
+struct cache_entry {
+    int block_id;       // Cached data block id (valid only if used)
+    int hash_next;      // Next slot in the same hash bucket, -1 terminates
+    bool used;          // Slot holds a block
+    bool dirty;         // Block modified in memory, not yet written back
+    bool referenced;    // CLOCK reference bit
+};
+
+static uint32_t configured_capacity = BLOCK_CACHE_DEFAULT_BLOCKS; // Applied by block_cache_init()
+
+static struct cache_entry* entries = NULL;  // Slot descriptors
+static uint8_t* slab = NULL;                // capacity * block_size bytes of block data
+static int* buckets = NULL;                 // Hash heads, -1 for empty bucket
+static uint32_t bucket_mask = 0;            // Number of buckets - 1 (power of two)
+static uint32_t capacity = 0;               // Slots allocated; 0 means caching is off
+static uint32_t resident = 0;               // Slots in use
+static uint32_t clock_hand = 0;             // Next eviction candidate
+static uint32_t cache_block_size = 0;       // Bytes per cached block
+
+static struct block_cache_stats stats;      // Counters since last init
+
+/* ---------------- Internal helpers ---------------- */
+
+static inline uint32_t hash_block(const int block_id) {
+    // Multiplicative hash; consecutive ids spread across buckets
+    return ((uint32_t)block_id * 2654435761u) & bucket_mask;
+}
+
+static inline uint8_t* slot_data(const uint32_t slot) {
+    return slab + (size_t)slot * cache_block_size;
+}
+
+static uint64_t block_offset(const int block_id) {
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+    return sb_disk->data_blocks_offset + (uint64_t)block_id * sb_disk->block_size;
+}
+
+static int lookup(const int block_id) {
+    for (int i = buckets[hash_block(block_id)]; i >= 0; i = entries[i].hash_next) {
+        if (entries[i].block_id == block_id) return i;
+    }
+    return -1;
+}
+
+static void unlink_slot(const uint32_t slot) {
+    int* link = &buckets[hash_block(entries[slot].block_id)];
+    while (*link >= 0) {
+        if (*link == (int)slot) {
+            *link = entries[slot].hash_next;
+            return;
+        }
+        link = &entries[*link].hash_next;
+    }
+}
+
+static bool write_back(const uint32_t slot) {
+    if (!entries[slot].dirty) return true;
+    if (!disk_write(slot_data(slot), block_offset(entries[slot].block_id), cache_block_size)) return false;
+    entries[slot].dirty = false;
+    stats.writebacks++;
+    return true;
+}
+
+// Find a slot for block_id: a never-used slot first, otherwise a CLOCK victim
+static int claim_slot(const int block_id) {
+    uint32_t slot;
+    if (resident < capacity) {
+        slot = resident++;
+    } else {
+        for (;;) {
+            slot = clock_hand;
+            clock_hand = (clock_hand + 1) % capacity;
+            if (!entries[slot].used || !entries[slot].referenced) break;
+            entries[slot].referenced = false;
+        }
+
+        // A victim that cannot be written back must stay cached
+        if (entries[slot].used) {
+            if (!write_back(slot)) return -1;
+            unlink_slot(slot);
+            stats.evictions++;
+        }
+    }
+
+    entries[slot].block_id = block_id;
+    entries[slot].used = true;
+    entries[slot].dirty = false;
+    entries[slot].referenced = true;
+
+    const uint32_t b = hash_block(block_id);
+    entries[slot].hash_next = buckets[b];
+    buckets[b] = (int)slot;
+    return (int)slot;
+}
+
+// Drop a slot that could not be filled (e.g. failed read) or whose block changed on disk
+static void discard_slot(const int slot) {
+    unlink_slot((uint32_t)slot);
+    entries[slot].used = false;
+    entries[slot].dirty = false;
+    entries[slot].referenced = false;
+}
+
+static inline bool slot_in_run(const uint32_t slot, const int first_block, const uint32_t count) {
+    return entries[slot].used && entries[slot].block_id >= first_block &&
+           (uint32_t)(entries[slot].block_id - first_block) < count;
+}
+
+// Returns the slot holding block_id, reading it from disk on a miss
+static int get_slot(const int block_id) {
+    int slot = lookup(block_id);
+    if (slot >= 0) {
+        stats.hits++;
+        entries[slot].referenced = true;
+        return slot;
+    }
+
+    stats.misses++;
+    slot = claim_slot(block_id);
+    if (slot < 0) return -1;
+
+    if (!disk_read(slot_data((uint32_t)slot), block_offset(block_id), cache_block_size)) {
+        discard_slot(slot);
+        return -1;
+    }
+    return slot;
+}
+
+static void release(void) {
+    free(entries); entries = NULL;
+    free(slab); slab = NULL;
+    free(buckets); buckets = NULL;
+    capacity = 0;
+    resident = 0;
+    clock_hand = 0;
+}
+
+static int compare_slots_by_block(const void* a, const void* b) {
+    const int ba = entries[*(const uint32_t*)a].block_id;
+    const int bb = entries[*(const uint32_t*)b].block_id;
+    return (ba > bb) - (ba < bb);
+}
+
+// Disk-layer hook: write back on fs_sync(), drop everything on fs_unmount()
+static void flush_hook(const bool unmounting) {
+    block_cache_flush();
+    if (unmounting) release();
+}
+
+/* ---------------- Public API ---------------- */
+
+void block_cache_set_capacity(const uint32_t blocks) {
+    configured_capacity = blocks;
+}
+
+bool block_cache_init(const uint32_t block_size) {
+    release();
+    memset(&stats, 0, sizeof(stats));
+    cache_block_size = block_size;
+
+    // A mapped container is already memory; a second copy would only cost memcpy
+    if (configured_capacity == 0 || disk_is_mapped()) return true;
+
+    uint32_t nbuckets = 1;
+    while (nbuckets < configured_capacity * 2) nbuckets <<= 1;
+
+    entries = calloc(configured_capacity, sizeof(*entries));
+    slab = malloc((size_t)configured_capacity * block_size);
+    buckets = malloc(nbuckets * sizeof(*buckets));
+    if (!entries || !slab || !buckets) {
+        fprintf(stderr, "block_cache_init: cannot allocate %u blocks, caching disabled\n", configured_capacity);
+        release();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nbuckets; i++) buckets[i] = -1;
+    bucket_mask = nbuckets - 1;
+    capacity = configured_capacity;
+
+    fs_register_flush_hook(flush_hook);
+    return true;
+}
+
+bool block_cache_read(const int block_id, void* buffer) {
+    if (capacity == 0) return disk_read(buffer, block_offset(block_id), cache_block_size);
+
+    const int slot = get_slot(block_id);
+    if (slot < 0) {
+        memset(buffer, 0, cache_block_size);
+        return false;
+    }
+    memcpy(buffer, slot_data((uint32_t)slot), cache_block_size);
+    return true;
+}
+
+bool block_cache_write(const int block_id, const void* buffer) {
+    if (capacity == 0) return disk_write(buffer, block_offset(block_id), cache_block_size);
+
+    // Whole-block overwrite: a miss needs no read from disk
+    int slot = lookup(block_id);
+    if (slot >= 0) {
+        stats.hits++;
+    } else {
+        stats.misses++;
+        slot = claim_slot(block_id);
+        if (slot < 0) return disk_write(buffer, block_offset(block_id), cache_block_size);
+    }
+
+    memcpy(slot_data((uint32_t)slot), buffer, cache_block_size);
+    entries[slot].dirty = true;
+    entries[slot].referenced = true;
+    return true;
+}
+
+bool block_cache_read_run(const int first_block, const uint32_t count, void* buffer) {
+    const bool ok = disk_read(buffer, block_offset(first_block), count * cache_block_size);
+    if (capacity == 0) return ok;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const int slot = lookup(first_block + (int)i);
+        if (slot >= 0) memcpy((uint8_t*)buffer + (size_t)i * cache_block_size, slot_data((uint32_t)slot), cache_block_size);
+    }
+    return ok;
+}
+
+bool block_cache_write_run(const int first_block, const uint32_t count, const void* buffer) {
+    if (!disk_write(buffer, block_offset(first_block), count * cache_block_size)) return false;
+    if (capacity == 0) return true;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const int slot = lookup(first_block + (int)i);
+        if (slot < 0) continue;
+        memcpy(slot_data((uint32_t)slot), (const uint8_t*)buffer + (size_t)i * cache_block_size, cache_block_size);
+        entries[slot].dirty = false;
+    }
+    return true;
+}
+
+const void* block_cache_peek(const int block_id) {
+    if (capacity == 0) return NULL;
+
+    const int slot = get_slot(block_id);
+    return slot < 0 ? NULL : slot_data((uint32_t)slot);
+}
+
+void block_cache_flush(void) {
+    if (capacity == 0) return;
+
+    // Write back in ascending block order so the container sees sequential I/O
+    uint32_t* dirty = malloc(resident * sizeof(*dirty));
+    uint32_t count = 0;
+    if (!dirty) {
+        for (uint32_t i = 0; i < resident; i++) write_back(i);
+        return;
+    }
+
+    for (uint32_t i = 0; i < resident; i++) {
+        if (entries[i].used && entries[i].dirty) dirty[count++] = i;
+    }
+    qsort(dirty, count, sizeof(*dirty), compare_slots_by_block);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!write_back(dirty[i])) {
+            fprintf(stderr, "block_cache_flush: failed to write block %d\n", entries[dirty[i]].block_id);
+        }
+    }
+    free(dirty);
+}
+
+void block_cache_flush_run(const int first_block, const uint32_t count) {
+    if (capacity == 0) return;
+
+    // Bounded by the capacity whatever the run length
+    for (uint32_t i = 0; i < resident; i++) {
+        if (slot_in_run(i, first_block, count) && !write_back(i))
+            fprintf(stderr, "block_cache_flush_run: failed to write block %d\n", entries[i].block_id);
+    }
+}
+
+bool block_cache_flush_block(const int block_id) {
+    if (capacity == 0) return true;
+
+    const int slot = lookup(block_id);
+    return slot < 0 || write_back((uint32_t)slot);
+}
+
+void block_cache_drop_run(const int first_block, const uint32_t count) {
+    if (capacity == 0) return;
+
+    // Bytes of a partial overwrite that the caller leaves alone must not be lost: write back first
+    for (uint32_t i = 0; i < resident; i++) {
+        if (!slot_in_run(i, first_block, count)) continue;
+        if (!write_back(i))
+            fprintf(stderr, "block_cache_drop_run: failed to write block %d\n", entries[i].block_id);
+        discard_slot((int)i);
+    }
+}
+
+void block_cache_invalidate(void) {
+    if (capacity == 0) return;
+
+    for (uint32_t i = 0; i <= bucket_mask; i++) buckets[i] = -1;
+    memset(entries, 0, capacity * sizeof(*entries));
+    resident = 0;
+    clock_hand = 0;
+}
+
+void block_cache_get_stats(struct block_cache_stats* out) {
+    *out = stats;
+    out->capacity = capacity;
+    out->resident = resident;
+}
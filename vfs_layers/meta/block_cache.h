@@ -0,0 +1,146 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Default block cache capacity in blocks (4 MiB with 4 KiB blocks).
+ */
+#define BLOCK_CACHE_DEFAULT_BLOCKS 1024
+
+/**
+ * @brief Counters describing block cache effectiveness since the last mount.
+ */
+struct block_cache_stats {
+    /** @brief Configured capacity in blocks (0 when the cache is disabled). */
+    uint32_t capacity;
+    /** @brief Blocks currently held in the cache. */
+    uint32_t resident;
+    /** @brief Lookups served from memory. */
+    uint64_t hits;
+    /** @brief Lookups that found no cached copy of the block. */
+    uint64_t misses;
+    /** @brief Entries recycled to make room for another block. */
+    uint64_t evictions;
+    /** @brief Dirty blocks written back to the container. */
+    uint64_t writebacks;
+};
+
+/**
+ * @brief Sets the capacity used by the next block_cache_init().
+ *
+ * A capacity of 0 disables caching: reads and writes go straight to disk.
+ *
+ * @param blocks Number of blocks the cache may hold.
+ */
+void block_cache_set_capacity(uint32_t blocks);
+
+/**
+ * @brief (Re)initializes the cache for the mounted filesystem.
+ *
+ * Drops any previous contents and resets the statistics. Must be called after
+ * fs_mount(); registers the write-back hook with the disk layer.
+ *
+ * @param block_size Size of one data block in bytes.
+ * @return true on success, false if the cache memory could not be allocated.
+ */
+bool block_cache_init(uint32_t block_size);
+
+/**
+ * @brief Reads a block through the cache.
+ *
+ * @param block_id Data block id.
+ * @param buffer Output buffer of block_size bytes.
+ * @return true on success, false on I/O error.
+ */
+bool block_cache_read(int block_id, void* buffer);
+
+/**
+ * @brief Writes a block into the cache; it reaches disk on eviction or flush.
+ *
+ * @param block_id Data block id.
+ * @param buffer Input buffer of block_size bytes.
+ * @return true on success, false on I/O error.
+ */
+bool block_cache_write(int block_id, const void* buffer);
+
+/**
+ * @brief Reads count consecutive blocks with one disk read.
+ *
+ * Bypasses the cache (bulk data would only evict metadata) but stays
+ * coherent with it: cached copies, which may be newer than the container,
+ * are overlaid on the result.
+ *
+ * @param first_block First data block id.
+ * @param count Number of blocks.
+ * @param buffer Output buffer of count * block_size bytes.
+ * @return true on success, false on I/O error.
+ */
+bool block_cache_read_run(int first_block, uint32_t count, void* buffer);
+
+/**
+ * @brief Writes count consecutive blocks with one disk write.
+ *
+ * Bypasses the cache; cached copies of the blocks are refreshed and marked clean.
+ *
+ * @param first_block First data block id.
+ * @param count Number of blocks.
+ * @param buffer Input buffer of count * block_size bytes.
+ * @return true on success, false on I/O error.
+ */
+bool block_cache_write_run(int first_block, uint32_t count, const void* buffer);
+
+/**
+ * @brief Returns a read-only pointer to the cached copy of a block.
+ *
+ * The pointer stays valid only until the next block cache call.
+ *
+ * @param block_id Data block id.
+ * @return Pointer to the cached block, or NULL if the cache is disabled or on I/O error.
+ */
+const void* block_cache_peek(int block_id);
+
+/**
+ * @brief Writes all dirty blocks back to the container in block order.
+ */
+void block_cache_flush(void);
+
+/**
+ * @brief Writes dirty cached copies of a block range back to the container.
+ *
+ * Used before the range is read from the container behind the cache's back.
+ *
+ * @param first_block First data block id.
+ * @param count Number of blocks.
+ */
+void block_cache_flush_run(int first_block, uint32_t count);
+
+/**
+ * @brief Writes one block back now if its cached copy is dirty.
+ *
+ * @param block_id Data block id.
+ * @return true on success or if nothing was pending, false on I/O error.
+ */
+bool block_cache_flush_block(int block_id);
+
+/**
+ * @brief Writes back and forgets cached copies of a block range.
+ *
+ * Used before the range is overwritten in the container behind the cache's back.
+ *
+ * @param first_block First data block id.
+ * @param count Number of blocks.
+ */
+void block_cache_drop_run(int first_block, uint32_t count);
+
+/**
+ * @brief Discards all cached blocks without writing them back.
+ */
+void block_cache_invalidate(void);
+
+/**
+ * @brief Copies the current cache counters into stats.
+ *
+ * @param stats Output structure.
+ */
+void block_cache_get_stats(struct block_cache_stats* stats);
@@ -0,0 +1,512 @@
+#include "block_map.h"
+
+#include <string.h>
+
+/** @brief Block ids held by one indirect table. */
+#define POINTERS_PER_BLOCK (BLOCK_SIZE / (int)sizeof(uint32_t))
+
+/** @brief File blocks addressable by a pointer map (5 direct + one indirect table). */
+#define POINTER_MAP_BLOCKS ((uint32_t)(5 + POINTERS_PER_BLOCK))
+
+/* Extent tree node as stored in a data block */
+union extent_block {
+    struct {
+        struct extent_header header;
+        struct extent_record records[EXTENT_NODE_RECORDS];
+    };
+    uint8_t raw[BLOCK_SIZE];
+};
+
+/* One level of a root-to-leaf descent; level 0 is the root inside the inode */
+struct path_level {
+    struct extent_header* header;
+    struct extent_record* records;
+    uint32_t block;     // Node block, FS_INVALID_BLOCK for the root
+    int index;          // Record followed to the level below (-1: none yet)
+    bool dirty;         // Node modified, must be written back
+};
+
+static inline bool uses_extents(const struct pseudo_inode* inode) {
+    return (inode->flags & INODE_FLAG_EXTENTS) != 0;
+}
+
+static inline uint32_t min_u32(const uint64_t a, const uint32_t b) {
+    return a < b ? (uint32_t)a : b;
+}
+
+/* ---------------- Pointer map (direct + single indirect) ---------------- */
+
+static uint32_t pointer_at(const struct pseudo_inode* inode, const uint32_t* table, const uint32_t logical) {
+    if (logical < 5) return inode->direct_blocks[logical];
+    return table ? table[logical - 5] : FS_INVALID_BLOCK;
+}
+
+static uint32_t pointer_lookup(const struct pseudo_inode* inode, const uint32_t logical, const uint32_t max, uint32_t* physical) {
+    *physical = FS_INVALID_BLOCK;
+    if (logical >= POINTER_MAP_BLOCKS) return max; // Beyond the map: one endless hole
+
+    // The indirect table is only needed when the run may reach past the direct blocks
+    uint32_t local[POINTERS_PER_BLOCK];
+    const uint32_t* table = NULL;
+    if ((uint64_t)logical + max > 5 && inode->indirect_block != FS_INVALID_BLOCK) {
+        table = peek_block((int)inode->indirect_block);
+        if (!table) {
+            read_block((int)inode->indirect_block, local);
+            table = local;
+        }
+    }
+
+    const uint32_t first = pointer_at(inode, table, logical);
+    uint32_t run = 1;
+    while (run < max && logical + run < POINTER_MAP_BLOCKS) {
+        const uint32_t next = pointer_at(inode, table, logical + run);
+        if (first == FS_INVALID_BLOCK ? next != FS_INVALID_BLOCK : next != first + run) break;
+        run++;
+    }
+
+    // A hole reaching the end of the map never ends
+    if (first == FS_INVALID_BLOCK && logical + run == POINTER_MAP_BLOCKS) run = max;
+
+    *physical = first;
+    return run;
+}
+
+static bool pointer_insert(struct pseudo_inode* inode, const uint32_t logical, const uint32_t start, const uint32_t length) {
+    if (logical >= POINTER_MAP_BLOCKS || length > POINTER_MAP_BLOCKS - logical) return false;
+
+    // Get the indirect table ready before touching anything, so failure leaves the map unchanged
+    uint32_t table[POINTERS_PER_BLOCK];
+    const bool needs_table = logical + length > 5;
+    if (needs_table) {
+        if (inode->indirect_block == FS_INVALID_BLOCK) {
+            const int block = allocate_free_block();
+            if (block < 0) return false;
+            inode->indirect_block = (uint32_t)block;
+            for (int k = 0; k < POINTERS_PER_BLOCK; k++) table[k] = FS_INVALID_BLOCK;
+        } else {
+            read_block((int)inode->indirect_block, table);
+        }
+    }
+
+    for (uint32_t i = 0; i < length; i++) {
+        const uint32_t l = logical + i;
+        if (l < 5) inode->direct_blocks[l] = start + i;
+        else table[l - 5] = start + i;
+    }
+
+    if (needs_table) write_block((int)inode->indirect_block, table);
+    return true;
+}
+
+static void pointer_release(struct pseudo_inode* inode) {
+    for (int i = 0; i < 5; i++) {
+        if (inode->direct_blocks[i] != FS_INVALID_BLOCK)
+            free_block((int)inode->direct_blocks[i]);
+        inode->direct_blocks[i] = FS_INVALID_BLOCK;
+    }
+
+    if (inode->indirect_block != FS_INVALID_BLOCK) {
+        uint32_t table[POINTERS_PER_BLOCK];
+        read_block((int)inode->indirect_block, table);
+        for (int i = 0; i < POINTERS_PER_BLOCK; i++) {
+            if (table[i] != FS_INVALID_BLOCK)
+                free_block((int)table[i]);
+        }
+        free_block((int)inode->indirect_block);
+        inode->indirect_block = FS_INVALID_BLOCK;
+    }
+}
+
+static void pointer_truncate(struct pseudo_inode* inode, const uint32_t first) {
+    for (uint32_t i = first; i < 5; i++) {
+        if (inode->direct_blocks[i] != FS_INVALID_BLOCK)
+            free_block((int)inode->direct_blocks[i]);
+        inode->direct_blocks[i] = FS_INVALID_BLOCK;
+    }
+
+    if (inode->indirect_block == FS_INVALID_BLOCK) return;
+
+    uint32_t table[POINTERS_PER_BLOCK];
+    read_block((int)inode->indirect_block, table);
+
+    const uint32_t keep = first > 5 ? first - 5 : 0;
+    bool changed = false;
+    bool used = false;
+    for (uint32_t i = 0; i < POINTERS_PER_BLOCK; i++) {
+        if (table[i] == FS_INVALID_BLOCK) continue;
+        if (i < keep) {
+            used = true;
+            continue;
+        }
+        free_block((int)table[i]);
+        table[i] = FS_INVALID_BLOCK;
+        changed = true;
+    }
+
+    // A table with no pointers left is freed as well
+    if (!used) {
+        free_block((int)inode->indirect_block);
+        inode->indirect_block = FS_INVALID_BLOCK;
+    } else if (changed) {
+        write_block((int)inode->indirect_block, table);
+    }
+}
+
+static void pointer_walk(const struct pseudo_inode* inode, const block_map_visitor visit, void* ctx) {
+    uint32_t logical = 0;
+    while (logical < POINTER_MAP_BLOCKS) {
+        uint32_t physical;
+        const uint32_t run = pointer_lookup(inode, logical, POINTER_MAP_BLOCKS - logical, &physical);
+        if (physical != FS_INVALID_BLOCK) visit(ctx, logical, physical, run);
+        logical += run;
+    }
+}
+
+/* ---------------- Extent tree ---------------- */
+
+static bool load_node(const uint32_t block, union extent_block* node) {
+    if (!read_block((int)block, node)) return false;
+
+    const struct extent_header* h = &node->header;
+    if (h->magic != EXTENT_MAGIC || h->max > EXTENT_NODE_RECORDS || h->entries > h->max || h->depth >= EXTENT_MAX_DEPTH) {
+        printf("ERROR: corrupted extent node in block %u\n", block);
+        return false;
+    }
+    return true;
+}
+
+// Index of the last record with logical <= target, or -1 if target precedes them all
+static int find_record(const struct extent_header* header, const struct extent_record* records, const uint32_t target) {
+    int lo = 0;
+    int hi = (int)header->entries - 1;
+    int found = -1;
+    while (lo <= hi) {
+        const int mid = (lo + hi) / 2;
+        if (records[mid].logical <= target) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return found;
+}
+
+static uint32_t extent_lookup(const struct pseudo_inode* inode, const uint32_t logical, const uint32_t max, uint32_t* physical) {
+    const struct extent_header* header = &inode->extent_root;
+    const struct extent_record* records = inode->extents;
+    union extent_block node;
+
+    // First file block past the subtree being searched
+    uint64_t bound = (uint64_t)UINT32_MAX + 1;
+    *physical = FS_INVALID_BLOCK;
+
+    for (int level = 0; level <= EXTENT_MAX_DEPTH; level++) {
+        const int i = find_record(header, records, logical);
+
+        if (header->depth == 0) {
+            if (i >= 0 && logical - records[i].logical < records[i].length) {
+                const uint32_t offset = logical - records[i].logical;
+                *physical = records[i].start + offset;
+                return min_u32(records[i].length - offset, max);
+            }
+            const uint64_t next = (i + 1 < (int)header->entries) ? records[i + 1].logical : bound;
+            return min_u32(next - logical, max);
+        }
+
+        if (i < 0) {
+            // Before the first child (or an empty index): hole up to the first mapped block
+            const uint64_t next = header->entries > 0 ? records[0].logical : bound;
+            return min_u32(next - logical, max);
+        }
+
+        if (i + 1 < (int)header->entries) bound = records[i + 1].logical;
+        if (!load_node(records[i].start, &node)) return 1;
+        header = &node.header;
+        records = node.records;
+    }
+
+    printf("ERROR: extent tree of inode %u is too deep\n", inode->id);
+    return 1;
+}
+
+static void write_path(struct path_level* path, const int levels) {
+    for (int l = 1; l < levels; l++) {
+        // A node's header sits at the start of its block buffer
+        if (path[l].dirty) write_block((int)path[l].block, path[l].header);
+        path[l].dirty = false;
+    }
+}
+
+// Root-to-leaf descent towards logical; lowers first keys on the way so the leaf range covers it
+static int descend(struct pseudo_inode* inode, const uint32_t logical, struct path_level* path, union extent_block* nodes) {
+    path[0] = (struct path_level){ &inode->extent_root, inode->extents, FS_INVALID_BLOCK, -1, false };
+
+    int level = 0;
+    for (;;) {
+        struct path_level* p = &path[level];
+        p->index = find_record(p->header, p->records, logical);
+        if (p->header->depth == 0) return level + 1;
+
+        if (p->header->entries == 0 || level == EXTENT_MAX_DEPTH) {
+            printf("ERROR: corrupted extent tree in inode %u\n", inode->id);
+            return -1;
+        }
+        if (p->index < 0) {
+            p->index = 0;
+            p->records[0].logical = logical;
+            p->dirty = true;
+        }
+
+        const uint32_t child = p->records[p->index].start;
+        if (!load_node(child, &nodes[level])) return -1;
+        level++;
+        path[level] = (struct path_level){ &nodes[level - 1].header, nodes[level - 1].records, child, -1, false };
+    }
+}
+
+static inline bool node_full(const struct path_level* p) {
+    return p->header->entries >= p->header->max;
+}
+
+// Inserts record at position pos of a node with free space
+static void node_insert(struct path_level* p, const int pos, const struct extent_record record) {
+    memmove(&p->records[pos + 1], &p->records[pos], (size_t)(p->header->entries - pos) * sizeof(struct extent_record));
+    p->records[pos] = record;
+    p->header->entries++;
+    p->dirty = true;
+}
+
+// Moves the root records into a new block and makes the root a one-entry index above it
+static bool grow_root(struct pseudo_inode* inode) {
+    struct extent_header* root = &inode->extent_root;
+    if (root->depth >= EXTENT_MAX_DEPTH) {
+        printf("ERROR: extent tree of inode %u is full\n", inode->id);
+        return false;
+    }
+
+    const int block = allocate_free_block();
+    if (block < 0) return false;
+
+    union extent_block node;
+    memset(&node, 0, sizeof(node));
+    node.header = (struct extent_header){ EXTENT_MAGIC, root->entries, EXTENT_NODE_RECORDS, root->depth };
+    memcpy(node.records, inode->extents, root->entries * sizeof(struct extent_record));
+    write_block(block, &node);
+
+    const uint32_t first = root->entries > 0 ? inode->extents[0].logical : 0;
+    memset(inode->extents, 0, sizeof(inode->extents));
+    inode->extents[0] = (struct extent_record){ first, (uint32_t)block, 0 };
+    root->entries = 1;
+    root->depth++;
+    return true;
+}
+
+// Splits the full block node at path[level] in two; its parent must have room
+static bool split_node(struct path_level* path, const int level) {
+    struct path_level* p = &path[level];
+    struct path_level* parent = &path[level - 1];
+
+    const int block = allocate_free_block();
+    if (block < 0) return false;
+
+    const int keep = p->header->entries / 2;
+    const int move = p->header->entries - keep;
+
+    union extent_block sibling;
+    memset(&sibling, 0, sizeof(sibling));
+    sibling.header = (struct extent_header){ EXTENT_MAGIC, (uint16_t)move, EXTENT_NODE_RECORDS, p->header->depth };
+    memcpy(sibling.records, &p->records[keep], (size_t)move * sizeof(struct extent_record));
+    write_block(block, &sibling);
+
+    p->header->entries = (uint16_t)keep;
+    p->dirty = true;
+
+    node_insert(parent, parent->index + 1, (struct extent_record){ sibling.records[0].logical, (uint32_t)block, 0 });
+    return true;
+}
+
+// Adds the run to leaf record i (last record before it) or to the one after, if physically adjacent
+static bool try_merge(struct path_level* leaf, const int i, const uint32_t logical, const uint32_t start, const uint32_t length) {
+    struct extent_record* r = leaf->records;
+    const int entries = leaf->header->entries;
+
+    if (i >= 0 && (uint64_t)r[i].logical + r[i].length == logical && (uint64_t)r[i].start + r[i].length == start &&
+        r[i].length <= UINT32_MAX - length) {
+        r[i].length += length;
+
+        // The run may close the gap to the next record
+        if (i + 1 < entries && (uint64_t)r[i].logical + r[i].length == r[i + 1].logical &&
+            (uint64_t)r[i].start + r[i].length == r[i + 1].start && r[i].length <= UINT32_MAX - r[i + 1].length) {
+            r[i].length += r[i + 1].length;
+            memmove(&r[i + 1], &r[i + 2], (size_t)(entries - i - 2) * sizeof(struct extent_record));
+            leaf->header->entries--;
+        }
+        leaf->dirty = true;
+        return true;
+    }
+
+    if (i + 1 < entries && (uint64_t)logical + length == r[i + 1].logical && (uint64_t)start + length == r[i + 1].start &&
+        r[i + 1].length <= UINT32_MAX - length) {
+        r[i + 1].logical = logical;
+        r[i + 1].start = start;
+        r[i + 1].length += length;
+        leaf->dirty = true;
+        return true;
+    }
+    return false;
+}
+
+static bool extent_insert(struct pseudo_inode* inode, const uint32_t logical, const uint32_t start, const uint32_t length) {
+    if (length == 0) return true;
+    if (length - 1 > UINT32_MAX - logical) return false;
+
+    struct path_level path[EXTENT_MAX_DEPTH + 1];
+    union extent_block nodes[EXTENT_MAX_DEPTH];
+
+    // Each pass either inserts or splits one full node on the path, then descends again
+    for (;;) {
+        const int levels = descend(inode, logical, path, nodes);
+        if (levels < 0) return false;
+
+        struct path_level* leaf = &path[levels - 1];
+        if (try_merge(leaf, leaf->index, logical, start, length)) {
+            write_path(path, levels);
+            return true;
+        }
+        if (!node_full(leaf)) {
+            node_insert(leaf, leaf->index + 1, (struct extent_record){ logical, start, length });
+            write_path(path, levels);
+            return true;
+        }
+
+        // Split the highest full node whose parent has room; a full chain up to the root grows the tree
+        int level = levels - 1;
+        while (level > 0 && node_full(&path[level - 1])) level--;
+
+        const bool ok = level == 0 ? grow_root(inode) : split_node(path, level);
+        write_path(path, levels);
+        if (!ok) return false;
+    }
+}
+
+static void release_records(const struct extent_record* records, const int entries, const int depth) {
+    for (int i = 0; i < entries; i++) {
+        if (depth == 0) {
+            free_block_run(records[i].start, records[i].length);
+            continue;
+        }
+
+        union extent_block node;
+        if (load_node(records[i].start, &node))
+            release_records(node.records, node.header.entries, node.header.depth);
+        free_block((int)records[i].start);
+    }
+}
+
+// Unmaps file blocks from first on; child nodes left empty are freed and dropped from the parent
+static void truncate_records(struct extent_header* header, struct extent_record* records, const uint32_t first) {
+    while (header->entries > 0) {
+        struct extent_record* r = &records[header->entries - 1];
+
+        if (r->logical >= first) {
+            release_records(r, 1, header->depth);
+            header->entries--;
+            continue;
+        }
+
+        if (header->depth == 0) {
+            // Records are sorted: the last one starting before first is the only one to cut
+            const uint32_t keep = first - r->logical;
+            if (r->length > keep) {
+                free_block_run(r->start + keep, r->length - keep);
+                r->length = keep;
+            }
+            return;
+        }
+
+        union extent_block node;
+        if (!load_node(r->start, &node)) return;
+        truncate_records(&node.header, node.records, first);
+        if (node.header.entries > 0) {
+            write_block((int)r->start, &node);
+            return;
+        }
+
+        free_block((int)r->start);
+        header->entries--;
+    }
+}
+
+static void walk_records(const struct extent_record* records, const int entries, const int depth,
+                         const block_map_visitor visit, void* ctx) {
+    for (int i = 0; i < entries; i++) {
+        if (depth == 0) {
+            visit(ctx, records[i].logical, records[i].start, records[i].length);
+            continue;
+        }
+
+        union extent_block node;
+        if (load_node(records[i].start, &node))
+            walk_records(node.records, node.header.entries, node.header.depth, visit, ctx);
+    }
+}
+
+/* ---------------- Public API ---------------- */
+
+void block_map_init(struct pseudo_inode* inode) {
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+
+    if (sb_disk->features & FS_FEATURE_EXTENTS) {
+        inode->flags |= INODE_FLAG_EXTENTS;
+        memset(inode->extents, 0, sizeof(inode->extents));
+        inode->extent_root = (struct extent_header){ EXTENT_MAGIC, 0, INODE_INLINE_EXTENTS, 0 };
+    } else {
+        inode->flags &= ~INODE_FLAG_EXTENTS;
+        for (int i = 0; i < 5; i++) inode->direct_blocks[i] = FS_INVALID_BLOCK;
+        inode->indirect_block = FS_INVALID_BLOCK;
+    }
+}
+
+uint32_t block_map_max_blocks(const struct pseudo_inode* inode) {
+    return uses_extents(inode) ? UINT32_MAX : POINTER_MAP_BLOCKS;
+}
+
+uint32_t block_map_lookup(const struct pseudo_inode* inode, const uint32_t logical, const uint32_t max, uint32_t* physical) {
+    if (uses_extents(inode)) return extent_lookup(inode, logical, max, physical);
+    return pointer_lookup(inode, logical, max, physical);
+}
+
+bool block_map_insert(struct pseudo_inode* inode, const uint32_t logical, const uint32_t start, const uint32_t length) {
+    if (uses_extents(inode)) return extent_insert(inode, logical, start, length);
+    return pointer_insert(inode, logical, start, length);
+}
+
+void block_map_release(struct pseudo_inode* inode) {
+    if (!uses_extents(inode)) {
+        pointer_release(inode);
+        return;
+    }
+
+    release_records(inode->extents, inode->extent_root.entries, inode->extent_root.depth);
+    block_map_init(inode);
+}
+
+void block_map_truncate(struct pseudo_inode* inode, const uint32_t first) {
+    if (!uses_extents(inode)) {
+        pointer_truncate(inode, first);
+        return;
+    }
+
+    truncate_records(&inode->extent_root, inode->extents, first);
+
+    // An emptied tree starts over as an inline leaf
+    if (inode->extent_root.entries == 0) block_map_init(inode);
+}
+
+void block_map_walk(const struct pseudo_inode* inode, const block_map_visitor visit, void* ctx) {
+    if (uses_extents(inode))
+        walk_records(inode->extents, inode->extent_root.entries, inode->extent_root.depth, visit, ctx);
+    else
+        pointer_walk(inode, visit, ctx);
+}
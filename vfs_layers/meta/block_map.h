@@ -0,0 +1,108 @@
+#pragma once
+
+#include "meta_layer.h"
+
+/**
+ * @brief File block -> data block mapping of an inode.
+ *
+ * Hides the two on-disk formats behind one interface: the original pointer
+ * map (5 direct blocks + one indirect table) and the extent tree rooted in
+ * inodes with INODE_FLAG_EXTENTS. Functions that change the map update the
+ * inode structure in place; the caller writes the inode back.
+ */
+
+/**
+ * @brief Capacity of an extent tree node stored in a data block.
+ */
+#define EXTENT_NODE_RECORDS ((BLOCK_SIZE - (int)sizeof(struct extent_header)) / (int)sizeof(struct extent_record))
+
+/**
+ * @brief Maximum extent tree depth below the inode root.
+ *
+ * Four levels of EXTENT_NODE_RECORDS-wide nodes already exceed 2^32 extents.
+ */
+#define EXTENT_MAX_DEPTH 4
+
+/**
+ * @brief Visitor called by block_map_walk() for every mapped run, in file order.
+ *
+ * @param ctx Caller context.
+ * @param logical First file block of the run.
+ * @param start First data block of the run.
+ * @param length Number of blocks in the run.
+ */
+typedef void (*block_map_visitor)(void* ctx, uint32_t logical, uint32_t start, uint32_t length);
+
+/**
+ * @brief Initializes an empty map for a new inode.
+ *
+ * Uses an extent tree if the mounted image has FS_FEATURE_EXTENTS, the
+ * pointer map otherwise.
+ *
+ * @param inode Inode to initialize.
+ */
+void block_map_init(struct pseudo_inode* inode);
+
+/**
+ * @brief Number of file blocks the inode's map format can address.
+ *
+ * @param inode Inode.
+ * @return 5 + BLOCK_SIZE / 4 for pointer maps, UINT32_MAX for extent trees.
+ */
+uint32_t block_map_max_blocks(const struct pseudo_inode* inode);
+
+/**
+ * @brief Maps a file block to its data block.
+ *
+ * Also reports how far the answer holds: the returned run covers file
+ * blocks [logical, logical + run) which are either all mapped to consecutive
+ * data blocks or all unmapped (a hole).
+ *
+ * @param inode Inode.
+ * @param logical File block to look up.
+ * @param max Upper bound on the returned run length (at least 1).
+ * @param physical Output: first data block, or FS_INVALID_BLOCK for a hole.
+ * @return Run length in blocks (1..max).
+ */
+uint32_t block_map_lookup(const struct pseudo_inode* inode, uint32_t logical, uint32_t max, uint32_t* physical);
+
+/**
+ * @brief Maps file blocks [logical, logical + length) to data blocks [start, start + length).
+ *
+ * The file range must be unmapped. Adjacent runs are merged; index or
+ * indirect blocks are allocated as needed.
+ *
+ * @param inode Inode to update.
+ * @param logical First file block.
+ * @param start First data block.
+ * @param length Number of blocks.
+ * @return true on success, false if the format cannot address the range or no block was available.
+ */
+bool block_map_insert(struct pseudo_inode* inode, uint32_t logical, uint32_t start, uint32_t length);
+
+/**
+ * @brief Frees every data, index and indirect block of the inode and leaves an empty map.
+ *
+ * @param inode Inode to update.
+ */
+void block_map_release(struct pseudo_inode* inode);
+
+/**
+ * @brief Unmaps and frees every data block from file block first on.
+ *
+ * Index nodes and the indirect table are freed once nothing below them
+ * remains mapped.
+ *
+ * @param inode Inode to update.
+ * @param first First file block to drop.
+ */
+void block_map_truncate(struct pseudo_inode* inode, uint32_t first);
+
+/**
+ * @brief Calls visit for every mapped run of the inode in file order.
+ *
+ * @param inode Inode.
+ * @param visit Visitor.
+ * @param ctx Passed through to visit.
+ */
+void block_map_walk(const struct pseudo_inode* inode, block_map_visitor visit, void* ctx);
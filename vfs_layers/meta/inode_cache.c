@@ -0,0 +1,279 @@
+#include "inode_cache.h"
+#include "meta_layer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Upper bound on inodes merged into one write-back (bounds the stack buffer). */
+#define INODE_FLUSH_BATCH 128
+
+/* One cache slot holding a decoded inode */
+struct inode_entry {
+    struct pseudo_inode inode;  // Cached inode contents
+    int inode_id;               // Cached inode id (valid only if used)
+    int hash_next;              // Next slot in the same hash bucket, -1 terminates
+    bool used;                  // Slot holds an inode
+    bool dirty;                 // Modified since last write-back
+    bool referenced;            // CLOCK reference bit
+};
+
+static uint32_t configured_capacity = INODE_CACHE_DEFAULT_INODES; // Applied by inode_cache_init()
+
+static struct inode_entry* entries = NULL;  // Slots
+static int* buckets = NULL;                 // Hash heads, -1 for empty bucket
+static uint32_t bucket_mask = 0;            // Number of buckets - 1 (power of two)
+static uint32_t capacity = 0;               // Slots allocated; 0 means caching is off
+static uint32_t resident = 0;               // Slots in use
+static uint32_t clock_hand = 0;             // Next eviction candidate
+
+static struct inode_cache_stats stats;      // Counters since last init
+
+/* ---------------- Raw inode table access ---------------- */
+
+static inline bool legacy_table(void) {
+    return (fs_get_superblock_disk()->features & FS_FEATURE_EXTENTS) == 0;
+}
+
+static uint64_t inode_offset(const int inode_id) {
+    // Inodes are stored consecutively in the inode table region
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+    const uint64_t entry = legacy_table() ? sizeof(struct pseudo_inode_legacy) : sizeof(struct pseudo_inode);
+    return sb_disk->inode_table_offset + (uint64_t)inode_id * entry;
+}
+
+// Widen a pointer-map table entry into the in-memory layout
+static void inode_from_legacy(const struct pseudo_inode_legacy* in, struct pseudo_inode* out) {
+    memset(out, 0, sizeof(*out));
+    out->id = in->id;
+    out->file_size = in->file_size;
+    memcpy(out->direct_blocks, in->direct_blocks, sizeof(out->direct_blocks));
+    out->indirect_block = in->indirect_block;
+    out->amount_of_links = in->amount_of_links;
+    out->is_directory = in->is_directory;
+}
+
+// Narrow back; pointer-mapped files never exceed 32-bit sizes
+static void inode_to_legacy(const struct pseudo_inode* in, struct pseudo_inode_legacy* out) {
+    out->id = in->id;
+    out->file_size = (uint32_t)in->file_size;
+    memcpy(out->direct_blocks, in->direct_blocks, sizeof(out->direct_blocks));
+    out->indirect_block = in->indirect_block;
+    out->amount_of_links = in->amount_of_links;
+    out->is_directory = in->is_directory;
+}
+
+static bool load_inode(const int inode_id, struct pseudo_inode* inode) {
+    if (!legacy_table()) return disk_read(inode, inode_offset(inode_id), (uint32_t)sizeof(struct pseudo_inode));
+
+    struct pseudo_inode_legacy raw;
+    const bool ok = disk_read(&raw, inode_offset(inode_id), (uint32_t)sizeof(raw));
+    inode_from_legacy(&raw, inode);
+    return ok;
+}
+
+// Writes count consecutive inodes (count <= INODE_FLUSH_BATCH) with one disk write
+static bool store_inodes(const int first_id, const struct pseudo_inode* inodes, const uint32_t count) {
+    if (!legacy_table())
+        return disk_write(inodes, inode_offset(first_id), count * (uint32_t)sizeof(struct pseudo_inode));
+
+    struct pseudo_inode_legacy raw[INODE_FLUSH_BATCH];
+    for (uint32_t i = 0; i < count; i++) inode_to_legacy(&inodes[i], &raw[i]);
+    return disk_write(raw, inode_offset(first_id), count * (uint32_t)sizeof(struct pseudo_inode_legacy));
+}
+
+/* ---------------- Internal helpers ---------------- */
+
+static inline uint32_t hash_inode(const int inode_id) {
+    return ((uint32_t)inode_id * 2654435761u) & bucket_mask;
+}
+
+static int lookup(const int inode_id) {
+    for (int i = buckets[hash_inode(inode_id)]; i >= 0; i = entries[i].hash_next) {
+        if (entries[i].inode_id == inode_id) return i;
+    }
+    return -1;
+}
+
+static void unlink_slot(const uint32_t slot) {
+    int* link = &buckets[hash_inode(entries[slot].inode_id)];
+    while (*link >= 0) {
+        if (*link == (int)slot) {
+            *link = entries[slot].hash_next;
+            return;
+        }
+        link = &entries[*link].hash_next;
+    }
+}
+
+static bool write_back(const uint32_t slot) {
+    if (!entries[slot].dirty) return true;
+    if (!store_inodes(entries[slot].inode_id, &entries[slot].inode, 1)) return false;
+    entries[slot].dirty = false;
+    stats.writebacks++;
+    return true;
+}
+
+// Find a slot for inode_id: a never-used slot first, otherwise a CLOCK victim
+static int claim_slot(const int inode_id) {
+    uint32_t slot;
+    if (resident < capacity) {
+        slot = resident++;
+    } else {
+        for (;;) {
+            slot = clock_hand;
+            clock_hand = (clock_hand + 1) % capacity;
+            if (!entries[slot].referenced) break;
+            entries[slot].referenced = false;
+        }
+
+        if (!write_back(slot)) return -1;
+        unlink_slot(slot);
+    }
+
+    entries[slot].inode_id = inode_id;
+    entries[slot].used = true;
+    entries[slot].dirty = false;
+    entries[slot].referenced = true;
+
+    const uint32_t b = hash_inode(inode_id);
+    entries[slot].hash_next = buckets[b];
+    buckets[b] = (int)slot;
+    return (int)slot;
+}
+
+static void release(void) {
+    free(entries); entries = NULL;
+    free(buckets); buckets = NULL;
+    capacity = 0;
+    resident = 0;
+    clock_hand = 0;
+}
+
+static int compare_slots_by_inode(const void* a, const void* b) {
+    const int ia = entries[*(const uint32_t*)a].inode_id;
+    const int ib = entries[*(const uint32_t*)b].inode_id;
+    return (ia > ib) - (ia < ib);
+}
+
+// Disk-layer hook: write back on fs_sync(), drop everything on fs_unmount()
+static void flush_hook(const bool unmounting) {
+    inode_cache_flush();
+    if (unmounting) release();
+}
+
+/* ---------------- Public API ---------------- */
+
+void inode_cache_set_capacity(const uint32_t inodes) {
+    configured_capacity = inodes;
+}
+
+bool inode_cache_init(void) {
+    release();
+    memset(&stats, 0, sizeof(stats));
+    if (configured_capacity == 0) return true;
+
+    uint32_t nbuckets = 1;
+    while (nbuckets < configured_capacity * 2) nbuckets <<= 1;
+
+    entries = calloc(configured_capacity, sizeof(*entries));
+    buckets = malloc(nbuckets * sizeof(*buckets));
+    if (!entries || !buckets) {
+        fprintf(stderr, "inode_cache_init: cannot allocate %u inodes, caching disabled\n", configured_capacity);
+        release();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nbuckets; i++) buckets[i] = -1;
+    bucket_mask = nbuckets - 1;
+    capacity = configured_capacity;
+
+    fs_register_flush_hook(flush_hook);
+    return true;
+}
+
+bool inode_cache_read(const int inode_id, struct pseudo_inode* inode) {
+    if (capacity == 0) return load_inode(inode_id, inode);
+
+    int slot = lookup(inode_id);
+    if (slot >= 0) {
+        stats.hits++;
+        entries[slot].referenced = true;
+        *inode = entries[slot].inode;
+        return true;
+    }
+
+    stats.misses++;
+    if (!load_inode(inode_id, inode)) return false;
+
+    slot = claim_slot(inode_id);
+    if (slot >= 0) entries[slot].inode = *inode;
+    return true;
+}
+
+bool inode_cache_write(const int inode_id, const struct pseudo_inode* inode) {
+    if (capacity == 0) return store_inodes(inode_id, inode, 1);
+
+    int slot = lookup(inode_id);
+    if (slot < 0) {
+        // Whole-inode overwrite: nothing to read from disk
+        slot = claim_slot(inode_id);
+        if (slot < 0) return store_inodes(inode_id, inode, 1);
+    }
+
+    entries[slot].inode = *inode;
+    entries[slot].dirty = true;
+    entries[slot].referenced = true;
+    return true;
+}
+
+void inode_cache_flush(void) {
+    if (capacity == 0) return;
+
+    uint32_t* dirty = malloc(resident * sizeof(*dirty));
+    if (!dirty) {
+        for (uint32_t i = 0; i < resident; i++) write_back(i);
+        return;
+    }
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < resident; i++) {
+        if (entries[i].used && entries[i].dirty) dirty[count++] = i;
+    }
+    qsort(dirty, count, sizeof(*dirty), compare_slots_by_inode);
+
+    // Merge runs of consecutive inode ids into one contiguous inode-table write
+    struct pseudo_inode batch[INODE_FLUSH_BATCH];
+    uint32_t i = 0;
+    while (i < count) {
+        const int first_id = entries[dirty[i]].inode_id;
+        uint32_t n = 0;
+        while (i + n < count && n < INODE_FLUSH_BATCH &&
+               entries[dirty[i + n]].inode_id == first_id + (int)n) {
+            batch[n] = entries[dirty[i + n]].inode;
+            n++;
+        }
+
+        if (store_inodes(first_id, batch, n)) {
+            for (uint32_t k = 0; k < n; k++) entries[dirty[i + k]].dirty = false;
+            stats.writebacks += n;
+        } else {
+            fprintf(stderr, "inode_cache_flush: failed to write inodes %d..%d\n", first_id, first_id + (int)n - 1);
+        }
+        i += n;
+    }
+
+    free(dirty);
+}
+
+void inode_cache_flush_inode(const int inode_id) {
+    if (capacity == 0) return;
+
+    const int slot = lookup(inode_id);
+    if (slot >= 0 && !write_back((uint32_t)slot))
+        fprintf(stderr, "inode_cache_flush_inode: failed to write inode %d\n", inode_id);
+}
+
+void inode_cache_get_stats(struct inode_cache_stats* out) {
+    *out = stats;
+    out->capacity = capacity;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct pseudo_inode;
+
+/**
+ * @brief Default number of decoded inodes kept in memory.
+ */
+#define INODE_CACHE_DEFAULT_INODES 1024
+
+/**
+ * @brief Counters describing inode cache effectiveness since the last mount.
+ */
+struct inode_cache_stats {
+    /** @brief Configured capacity in inodes. */
+    uint32_t capacity;
+    /** @brief Lookups served from memory. */
+    uint64_t hits;
+    /** @brief Lookups that had to read the inode from the inode table. */
+    uint64_t misses;
+    /** @brief Dirty inodes written back to the inode table. */
+    uint64_t writebacks;
+};
+
+/**
+ * @brief Sets the capacity used by the next inode_cache_init().
+ *
+ * A capacity of 0 disables caching: every access hits the inode table.
+ *
+ * @param inodes Number of inodes the cache may hold.
+ */
+void inode_cache_set_capacity(uint32_t inodes);
+
+/**
+ * @brief (Re)initializes the cache for the mounted filesystem.
+ *
+ * Drops previous contents, resets statistics and registers the write-back
+ * hook with the disk layer.
+ *
+ * @return true on success, false if the cache memory could not be allocated.
+ */
+bool inode_cache_init(void);
+
+/**
+ * @brief Reads an inode through the cache.
+ *
+ * @param inode_id Inode id.
+ * @param inode Output inode structure.
+ * @return true on success, false on I/O error.
+ */
+bool inode_cache_read(int inode_id, struct pseudo_inode* inode);
+
+/**
+ * @brief Stores an inode in the cache and marks it dirty.
+ *
+ * Repeated writes to the same inode are merged into a single write-back.
+ *
+ * @param inode_id Inode id.
+ * @param inode Inode structure to store.
+ * @return true on success, false on I/O error.
+ */
+bool inode_cache_write(int inode_id, const struct pseudo_inode* inode);
+
+/**
+ * @brief Writes all dirty inodes back in inode-table order.
+ *
+ * Runs of consecutive dirty inodes are written with a single disk write.
+ */
+void inode_cache_flush(void);
+
+/**
+ * @brief Writes one inode back now if its cached copy is dirty.
+ *
+ * @param inode_id Inode id.
+ */
+void inode_cache_flush_inode(int inode_id);
+
+/**
+ * @brief Copies the current cache counters into stats.
+ *
+ * @param stats Output structure.
+ */
+void inode_cache_get_stats(struct inode_cache_stats* stats);
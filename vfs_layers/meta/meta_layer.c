@@ -1,4 +1,7 @@
 #include "meta_layer.h"
+#include "block_cache.h"
+#include "inode_cache.h"
+#include "bitmap.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -6,12 +9,14 @@
 static uint32_t free_inodes;   // Cached number of free inodes (computed from bitmap)
 static uint32_t free_blocks;   // Cached number of free blocks (computed from bitmap)
 
-/* Helpers for bitmap operations */
-static inline bool test_bit(const uint8_t *bitmap, const int idx) {
-    // Returns true if the bitmap bit at index idx is set
-    return (bitmap[idx / 8] & (1 << (idx % 8))) != 0;
-}
+static uint64_t next_inode_hint;  // Next-fit cursor for inode allocation (persisted in superblock)
+static uint64_t next_block_hint;  // Next-fit cursor for block allocation (persisted in superblock)
+
+static struct bitmap_summary inode_summary;  // Free-space index over the inode bitmap
+static struct bitmap_summary block_summary;  // Free-space index over the block bitmap
+static bool summaries_ready = false;         // Both summaries built for the current mount
 
+/* Helpers for bitmap operations */
 static inline void set_bit(uint8_t *bitmap, const int idx) {
     // Marks bitmap bit at index idx as used
     bitmap[idx / 8] |= (1 << (idx % 8));
@@ -22,8 +27,37 @@ static inline void clear_bit(uint8_t *bitmap, const int idx) {
     bitmap[idx / 8] &= ~(1 << (idx % 8));
 }
 
+// Blocks one recorded update may write (entry block, splits, new map nodes) before sync_recorded_writes() gives up
+#define RECORD_MAX_BLOCKS 64
+
+static int recorded_blocks[RECORD_MAX_BLOCKS]; // Blocks written since record_block_writes()
+static uint32_t recorded_count = 0;            // Valid entries of recorded_blocks
+static bool recording = false;                 // write_block() and write_blocks() note their blocks
+static bool record_overflow = false;           // More blocks were written than recorded
+
+// Free runs examined per extent before settling for the longest one seen
+#define ALLOC_MAX_CANDIDATES 64
+
+// Disk-layer hook: publish counters on every sync; summaries die with the mount
+static void metadata_flush_hook(const bool unmounting) {
+    if (!unmounting) {
+        // Exact counters travel with the superblock so a clean mount can skip the scan
+        fs_set_free_counts(free_inodes, free_blocks);
+        return;
+    }
+    bitmap_summary_free(&inode_summary);
+    bitmap_summary_free(&block_summary);
+    summaries_ready = false;
+}
+
+// Next free bit from the hint: via the summary when available, plain word scan otherwise
+static int64_t find_free(struct bitmap_summary* summary, const uint8_t* bm, const uint64_t nbits, const uint64_t hint) {
+    if (summaries_ready) return bitmap_summary_find_clear_from(summary, bm, hint);
+    return bitmap_find_clear_from(bm, nbits, hint);
+}
+
 void metadata_init(void) {
-    // Recompute free inode/block counters from the mounted filesystem bitmaps.
+    // Set up free counters, allocation cursors, summaries and caches for the mounted filesystem.
     const uint8_t* inode_bm = fs_get_inode_bitmap();
     if (!inode_bm) {
         printf("metadata_init(): inode bitmap not available\n");
@@ -42,103 +76,303 @@ void metadata_init(void) {
         return;
     }
 
-    // Count free inodes
-    free_inodes = 0;
-    for (uint32_t i = 0; i < sb_disk->total_inodes; i++) {
-        if (!test_bit(inode_bm, (int)i)) {
-            free_inodes++;
-        }
+    // Fresh block and inode caches for the newly mounted container
+    block_cache_init(sb_disk->block_size);
+    inode_cache_init();
+
+    // Resume next-fit allocation where the previous mount stopped
+    next_inode_hint = sb_disk->next_free_inode < sb_disk->total_inodes ? sb_disk->next_free_inode : 0;
+    next_block_hint = sb_disk->next_free_block < sb_disk->total_blocks ? sb_disk->next_free_block : 0;
+
+    // Set up the free-space summaries (regions are scanned on first use, not here); without them allocation falls back to flat scans
+    summaries_ready = bitmap_summary_build(&inode_summary, inode_bm, sb_disk->total_inodes) == 0 &&
+                      bitmap_summary_build(&block_summary, block_bm, sb_disk->total_blocks) == 0;
+    if (!summaries_ready) {
+        fprintf(stderr, "metadata_init(): cannot allocate bitmap summaries\n");
+        bitmap_summary_free(&inode_summary);
+        bitmap_summary_free(&block_summary);
     }
-
-    // Count free blocks
-    free_blocks = 0;
-    for (uint32_t i = 0; i < sb_disk->total_blocks; i++) {
-        if (!test_bit(block_bm, (int)i)) {
-            free_blocks++;
-        }
+    fs_register_flush_hook(metadata_flush_hook);
+
+    // A cleanly unmounted image carries exact free counters; otherwise recount
+    if (fs_mount_was_clean() &&
+        sb_disk->free_inodes <= sb_disk->total_inodes && sb_disk->free_blocks <= sb_disk->total_blocks) {
+        free_inodes = (uint32_t)sb_disk->free_inodes;
+        free_blocks = (uint32_t)sb_disk->free_blocks;
+    } else {
+        free_inodes = (uint32_t)(sb_disk->total_inodes - bitmap_count_set(inode_bm, sb_disk->total_inodes));
+        free_blocks = (uint32_t)(sb_disk->total_blocks - bitmap_count_set(block_bm, sb_disk->total_blocks));
     }
 }
 
 /* ---------------- Bitmap operations ---------------- */
 
 int allocate_free_inode(void) {
-    // Scan inode bitmap for the first free inode, mark it used, and return its id.
+    // Next-fit word scan from the cursor; mark the found inode used and return its id.
     uint8_t *bm = fs_get_inode_bitmap();
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
 
-    for (int i = 0; i < (int)sb_disk->total_inodes; i++) {
-        if (!test_bit(bm, i)) {
-            set_bit(bm, i);
-            if (free_inodes > 0) free_inodes--;
-            fs_mark_inode_bitmap_dirty();
-            return i;
-        }
-    }
+    const int64_t i = find_free(&inode_summary, bm, sb_disk->total_inodes, next_inode_hint);
+    if (i < 0) return -1; // No free inode available
+
+    set_bit(bm, (int)i);
+    if (summaries_ready) bitmap_summary_update(&inode_summary, bm, (uint64_t)i);
+    if (free_inodes > 0) free_inodes--;
+    fs_mark_inode_bitmap_dirty();
 
-    // No free inode available
-    return -1;
+    next_inode_hint = (uint64_t)i + 1;
+    fs_set_alloc_hints(next_inode_hint, next_block_hint);
+    return (int)i;
 }
 
 void free_inode(const int inode_id) {
     uint8_t *bm = fs_get_inode_bitmap();
     clear_bit(bm, inode_id);
+    if (summaries_ready) bitmap_summary_update(&inode_summary, bm, (uint64_t)inode_id);
     free_inodes++;
     fs_mark_inode_bitmap_dirty();
 }
 
 int allocate_free_block(void) {
-    // Scan block bitmap for the first free block, mark it used, and return its id.
+    // Next-fit word scan from the cursor; mark the found block used and return its id.
+    uint8_t *bm = fs_get_block_bitmap();
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+
+    const int64_t i = find_free(&block_summary, bm, sb_disk->total_blocks, next_block_hint);
+    if (i < 0) return -1; // No free block available
+
+    set_bit(bm, (int)i);
+    if (summaries_ready) bitmap_summary_update(&block_summary, bm, (uint64_t)i);
+    if (free_blocks > 0) free_blocks--;
+    fs_mark_block_bitmap_dirty();
+
+    next_block_hint = (uint64_t)i + 1;
+    fs_set_alloc_hints(next_inode_hint, next_block_hint);
+    return (int)i;
+}
+
+// Marks [start, start + length) used; the summary is refreshed once per touched word
+static void take_blocks(uint8_t* bm, const uint64_t start, const uint64_t length) {
+    const uint64_t end = start + length;
+    for (uint64_t b = start; b < end; b++) {
+        set_bit(bm, (int)b);
+        if (summaries_ready && ((b + 1) % BITMAP_WORD_BITS == 0 || b + 1 == end))
+            bitmap_summary_update(&block_summary, bm, b);
+    }
+    free_blocks = free_blocks > length ? free_blocks - (uint32_t)length : 0;
+}
+
+static void release_blocks(uint8_t* bm, const uint64_t start, const uint64_t length) {
+    const uint64_t end = start + length;
+    for (uint64_t b = start; b < end; b++) {
+        clear_bit(bm, (int)b);
+        if (summaries_ready && ((b + 1) % BITMAP_WORD_BITS == 0 || b + 1 == end))
+            bitmap_summary_update(&block_summary, bm, b);
+    }
+    free_blocks += (uint32_t)length;
+}
+
+void free_block_run(const uint32_t start, const uint32_t length) {
+    if (length == 0) return;
+    release_blocks(fs_get_block_bitmap(), start, length);
+    fs_mark_block_bitmap_dirty();
+}
+
+int allocate_free_blocks(const uint32_t count, struct block_extent* out_extents, const int max_extents) {
+    // Next-fit run search: prefer one run covering everything, fragment only when no such run is found.
+    if (count == 0) return 0;
+    if (count > free_blocks || max_extents <= 0) return -1;
+
     uint8_t *bm = fs_get_block_bitmap();
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+    const uint64_t total = sb_disk->total_blocks;
+
+    const uint64_t saved_hint = next_block_hint;
+    uint32_t remaining = count;
+    int extents = 0;
+    while (remaining > 0) {
+        uint64_t best_start = 0;
+        uint64_t best_length = 0;
+        uint64_t pos = next_block_hint;
+
+        for (int candidate = 0; candidate < ALLOC_MAX_CANDIDATES; candidate++) {
+            const int64_t start = find_free(&block_summary, bm, total, pos);
+            if (start < 0) break;
+
+            const uint64_t length = bitmap_clear_run(bm, total, (uint64_t)start, remaining);
+            if (length > best_length) {
+                best_start = (uint64_t)start;
+                best_length = length;
+            }
+            if (length >= remaining) break;
+            pos = (uint64_t)start + length; // Continue past the used bit that ended this run
+        }
 
-    for (int i = 0; i < (int)sb_disk->total_blocks; i++) {
-        if (!test_bit(bm, i)) {
-            set_bit(bm, i);
-            if (free_blocks > 0) free_blocks--;
-            fs_mark_block_bitmap_dirty();
-            return i;
+        if (best_length == 0 || extents == max_extents) {
+            // Counter out of step with the bitmap, or too fragmented for the caller: undo everything
+            for (int i = 0; i < extents; i++) release_blocks(bm, out_extents[i].start, out_extents[i].length);
+            next_block_hint = saved_hint;
+            return -1;
         }
+
+        take_blocks(bm, best_start, best_length);
+        out_extents[extents].start = (uint32_t)best_start;
+        out_extents[extents].length = (uint32_t)best_length;
+        extents++;
+
+        remaining -= (uint32_t)best_length;
+        next_block_hint = best_start + best_length;
     }
 
-    // No free block available
-    return -1;
+    fs_mark_block_bitmap_dirty();
+    fs_set_alloc_hints(next_inode_hint, next_block_hint);
+    return extents;
 }
 
 void free_block(const int block_id) {
     uint8_t *bm = fs_get_block_bitmap();
     clear_bit(bm, block_id);
+    if (summaries_ready) bitmap_summary_update(&block_summary, bm, (uint64_t)block_id);
     free_blocks++;
     fs_mark_block_bitmap_dirty();
 }
 
 /* ---------------- Inode operations ---------------- */
 
-void read_inode(const int inode_id, struct pseudo_inode* inode) {
-    // Inodes are stored consecutively in the inode table region
+bool read_inode(const int inode_id, struct pseudo_inode* inode) {
+    // Served from the decoded inode cache; misses read the inode-table slot
+    return inode_cache_read(inode_id, inode);
+}
+
+bool write_inode(const int inode_id, const struct pseudo_inode* inode) {
+    // Deferred: the inode-table slot is updated on eviction or fs_sync()
+    return inode_cache_write(inode_id, inode);
+}
+
+static void record_block(const int block_id) {
+    if (!recording) return;
+    for (uint32_t i = 0; i < recorded_count; i++) {
+        if (recorded_blocks[i] == block_id) return;
+    }
+    if (recorded_count == RECORD_MAX_BLOCKS) record_overflow = true;
+    else recorded_blocks[recorded_count++] = block_id;
+}
+
+void record_block_writes(void) {
+    recorded_count = 0;
+    record_overflow = false;
+    recording = true;
+}
+
+bool sync_recorded_writes(const int inode_id, const struct pseudo_inode* inode) {
+    recording = false;
+    bool ok = write_inode(inode_id, inode);
+    if (record_overflow) {
+        fs_sync();
+        return ok;
+    }
+
+    // Blocks and their allocation bits first: the inode on disk must not point at blocks missing there
+    for (uint32_t i = 0; i < recorded_count; i++) {
+        ok = block_cache_flush_block(recorded_blocks[i]) && ok;
+        ok = fs_write_block_bitmap_bit((uint64_t)recorded_blocks[i]) && ok;
+    }
+    inode_cache_flush_inode(inode_id);
+    return ok;
+}
+
+/* ---------------- Block operations ---------------- */
+
+bool read_block(const int block_id, void* buffer) {
+    // Mapped containers are read directly; otherwise go through the block cache
+    if (disk_is_mapped()) {
+        const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+        const uint64_t offset = sb_disk->data_blocks_offset + (uint64_t)block_id * sb_disk->block_size;
+        return disk_read(buffer, offset, sb_disk->block_size);
+    }
+    return block_cache_read(block_id, buffer);
+}
+
+bool write_block(const int block_id, const void* buffer) {
+    record_block(block_id);
+    if (disk_is_mapped()) {
+        const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+        const uint64_t offset = sb_disk->data_blocks_offset + (uint64_t)block_id * sb_disk->block_size;
+        return disk_write(buffer, offset, sb_disk->block_size);
+    }
+    return block_cache_write(block_id, buffer);
+}
+
+bool read_blocks(const int start, const uint32_t count, void* buffer) {
+    // Large sequential I/O in BLOCK_RUN_MAX_IO pieces
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
-    const uint32_t offset = sb_disk->inode_table_offset + (uint32_t)inode_id * (uint32_t)sizeof(struct pseudo_inode);
-    disk_read(inode, offset, (uint32_t)sizeof(struct pseudo_inode));
+    bool ok = true;
+    for (uint32_t done = 0; done < count; done += BLOCK_RUN_MAX_IO) {
+        const uint32_t n = (count - done < BLOCK_RUN_MAX_IO) ? count - done : BLOCK_RUN_MAX_IO;
+        uint8_t* dst = (uint8_t*)buffer + (size_t)done * sb_disk->block_size;
+        const int first = start + (int)done;
+
+        if (disk_is_mapped()) {
+            const uint64_t offset = sb_disk->data_blocks_offset + (uint64_t)first * sb_disk->block_size;
+            ok = disk_read(dst, offset, n * sb_disk->block_size) && ok;
+        } else {
+            ok = block_cache_read_run(first, n, dst) && ok;
+        }
+    }
+    return ok;
 }
 
-void write_inode(const int inode_id, const struct pseudo_inode* inode) {
-    // Persist an updated inode structure at its fixed inode-table slot
+bool write_blocks(const int start, const uint32_t count, const void* buffer) {
+    for (uint32_t i = 0; recording && i < count; i++) record_block(start + (int)i);
+
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
-    const uint32_t offset = sb_disk->inode_table_offset + (uint32_t)inode_id * (uint32_t)sizeof(struct pseudo_inode);
-    disk_write(inode, offset, (uint32_t)sizeof(struct pseudo_inode));
+    bool ok = true;
+    for (uint32_t done = 0; done < count; done += BLOCK_RUN_MAX_IO) {
+        const uint32_t n = (count - done < BLOCK_RUN_MAX_IO) ? count - done : BLOCK_RUN_MAX_IO;
+        const uint8_t* src = (const uint8_t*)buffer + (size_t)done * sb_disk->block_size;
+        const int first = start + (int)done;
+
+        if (disk_is_mapped()) {
+            const uint64_t offset = sb_disk->data_blocks_offset + (uint64_t)first * sb_disk->block_size;
+            ok = disk_write(src, offset, n * sb_disk->block_size) && ok;
+        } else {
+            ok = block_cache_write_run(first, n, src) && ok;
+        }
+    }
+    return ok;
 }
 
-/* ---------------- Block operations ---------------- */
+bool copy_blocks_to_fd(const int start, const uint64_t bytes, const int fd, const uint64_t fd_offset) {
+    const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+    const uint32_t count = (uint32_t)((bytes + sb_disk->block_size - 1) / sb_disk->block_size);
 
-void read_block(const int block_id, void* buffer) {
+    // The kernel reads the container itself: newer cached copies must be there first
+    if (!disk_is_mapped()) block_cache_flush_run(start, count);
+    return disk_copy_to_fd(fd, fd_offset, sb_disk->data_blocks_offset + (uint64_t)start * sb_disk->block_size, bytes);
+}
+
+bool copy_blocks_to_fd_direct(const int start, const uint64_t bytes, const int fd, const uint64_t fd_offset) {
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
-    const uint32_t offset = sb_disk->data_blocks_offset + block_id * sb_disk->block_size;
-    disk_read(buffer, (int) offset, (int) sb_disk->block_size);
+    return disk_copy_to_fd(fd, fd_offset, sb_disk->data_blocks_offset + (uint64_t)start * sb_disk->block_size, bytes);
 }
 
-void write_block(const int block_id, const void* buffer) {
+bool copy_blocks_from_fd(const int fd, const uint64_t fd_offset, const int start, const uint64_t bytes) {
     const struct superblock_disk* sb_disk = fs_get_superblock_disk();
-    const uint32_t offset = sb_disk->data_blocks_offset + block_id * sb_disk->block_size;
-    disk_write(buffer, (int) offset, (int) sb_disk->block_size);
+    const uint32_t count = (uint32_t)((bytes + sb_disk->block_size - 1) / sb_disk->block_size);
+
+    // Cached copies would be stale once the kernel has written the container
+    if (!disk_is_mapped()) block_cache_drop_run(start, count);
+    return disk_copy_from_fd(fd, fd_offset, sb_disk->data_blocks_offset + (uint64_t)start * sb_disk->block_size, bytes);
+}
+
+const void* peek_block(const int block_id) {
+    // Zero-copy access: into the mapping, or into the cached copy of the block
+    if (disk_is_mapped()) {
+        const struct superblock_disk* sb_disk = fs_get_superblock_disk();
+        const uint64_t offset = sb_disk->data_blocks_offset + (uint64_t)block_id * sb_disk->block_size;
+        return disk_peek(offset, sb_disk->block_size);
+    }
+    return block_cache_peek(block_id);
 }
 
 uint32_t get_amount_of_available_blocks() {
@@ -153,24 +387,38 @@ int fs_format(const int size_MB, const char* filename) {
     // Create/overwrite a VFS container file and initialize all on-disk structures.
     printf("fs_format(): formatting %d MB filesystem\n", size_MB);
 
+    if (size_MB <= 0) {
+        fprintf(stderr, "fs_format(): too small size\n");
+        return 1;
+    }
+
     const uint64_t size_bytes = (uint64_t)size_MB * 1024u * 1024u;
 
     // Account for superblock space; remaining area is divided among bitmaps, inode table and data blocks
     const uint64_t metadata_overhead = sizeof(struct superblock_disk);
+    if (size_bytes <= metadata_overhead) {
+        fprintf(stderr, "fs_format(): too small size\n");
+        return 1;
+    }
     const uint64_t usable_bytes = size_bytes - metadata_overhead;
 
     // Rough estimate of accounting overhead per data block (data + bitmap bits + inode rate)
     const double overhead_per_block = BLOCK_SIZE + 0.125 + 0.015625 + (sizeof(struct pseudo_inode) / 8.0);
-    const uint32_t total_blocks = (uint32_t)(usable_bytes / overhead_per_block);
+    const uint64_t total_blocks = (uint64_t)(usable_bytes / overhead_per_block);
 
-    const uint32_t total_inodes = total_blocks / 8;
+    if (total_blocks > FS_MAX_BLOCKS) {
+        fprintf(stderr, "fs_format(): too large size (max %llu blocks)\n", (unsigned long long)FS_MAX_BLOCKS);
+        return 1;
+    }
+
+    const uint64_t total_inodes = total_blocks / 8;
     if (total_inodes == 0) {
         fprintf(stderr, "fs_format(): too small size\n");
         return 1;
     }
 
-    const uint32_t inode_bitmap_size = (total_inodes + 7u) / 8u;
-    const uint32_t block_bitmap_size = (total_blocks + 7u) / 8u;
+    const uint64_t inode_bitmap_size = (total_inodes + 7u) / 8u;
+    const uint64_t block_bitmap_size = (total_blocks + 7u) / 8u;
 
     struct superblock_disk sb = (struct superblock_disk){0};
 
@@ -178,9 +426,10 @@ int fs_format(const int size_MB, const char* filename) {
     sb.magic = FS_MAGIC;
     sb.version = FS_VERSION;
     sb.block_size = BLOCK_SIZE;
+    sb.features = FS_FEATURE_EXTENTS;
 
     // Layout: [superblock][inode_bitmap][block_bitmap][inode_table][data_blocks]
-    sb.inode_bitmap_offset = (uint32_t)sizeof(struct superblock_disk);
+    sb.inode_bitmap_offset = sizeof(struct superblock_disk);
     sb.inode_bitmap_size = inode_bitmap_size;
 
     sb.block_bitmap_offset = sb.inode_bitmap_offset + sb.inode_bitmap_size;
@@ -189,11 +438,16 @@ int fs_format(const int size_MB, const char* filename) {
     sb.inode_table_offset = sb.block_bitmap_offset + sb.block_bitmap_size;
     sb.total_inodes = total_inodes;
 
-    const uint32_t inode_table_size = total_inodes * (uint32_t)sizeof(struct pseudo_inode);
+    const uint64_t inode_table_size = total_inodes * sizeof(struct pseudo_inode);
 
     sb.data_blocks_offset = sb.inode_table_offset + inode_table_size;
     sb.total_blocks = total_blocks;
 
+    // Fresh image: counters are exact (only the root inode and its block are used)
+    sb.state = FS_STATE_CLEAN;
+    sb.free_inodes = total_inodes - 1;
+    sb.free_blocks = total_blocks - 1;
+
     FILE* file = fopen(filename, "wb");
     if (!file) {
         perror("fs_format(): cannot create file");
@@ -234,16 +488,16 @@ int fs_format(const int size_MB, const char* filename) {
     // Write inode table: root inode + remaining zeroed inodes
     struct pseudo_inode root_inode = (struct pseudo_inode){0};
     root_inode.id = 0;
+    root_inode.flags = INODE_FLAG_EXTENTS;
     root_inode.is_directory = 1;
     root_inode.file_size = 0;
-    root_inode.direct_blocks[0] = 0;
-    for (int i = 1; i < 5; i++) root_inode.direct_blocks[i] = FS_INVALID_BLOCK;
-    root_inode.indirect_block = FS_INVALID_BLOCK;
+    root_inode.extent_root = (struct extent_header){ EXTENT_MAGIC, 1, INODE_INLINE_EXTENTS, 0 };
+    root_inode.extents[0] = (struct extent_record){ 0, 0, 1 }; // Root directory lives in block 0
 
     fwrite(&root_inode, sizeof(root_inode), 1, file);
 
     struct pseudo_inode zero_inode = (struct pseudo_inode){0};
-    for (uint32_t i = 1; i < total_inodes; i++) {
+    for (uint64_t i = 1; i < total_inodes; i++) {
         fwrite(&zero_inode, sizeof(zero_inode), 1, file);
     }
 
@@ -264,7 +518,7 @@ int fs_format(const int size_MB, const char* filename) {
         return 1;
     }
 
-    for (uint32_t i = 1; i < total_blocks; i++) {
+    for (uint64_t i = 1; i < total_blocks; i++) {
         fwrite(zero_buf, 1, BLOCK_SIZE, file);
     }
 
@@ -272,9 +526,9 @@ int fs_format(const int size_MB, const char* filename) {
     fclose(file);
 
     printf("Filesystem formatted successfully!\n");
-    printf("  Total blocks: %u\n", total_blocks);
-    printf("  Total inodes: %u\n", total_inodes);
+    printf("  Total blocks: %llu\n", (unsigned long long)total_blocks);
+    printf("  Total inodes: %llu\n", (unsigned long long)total_inodes);
     printf("  File size: ~%llu MB\n",
-           ((uint64_t)sb.data_blocks_offset + (uint64_t)total_blocks * (uint64_t)BLOCK_SIZE) / (1024u * 1024u));
+           (unsigned long long)((sb.data_blocks_offset + total_blocks * BLOCK_SIZE) / (1024u * 1024u)));
     return 0;
 }
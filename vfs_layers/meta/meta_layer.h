@@ -4,21 +4,13 @@
 #include <stdint.h>
 #include "../disk/disk_layer.h"
 
-/**
- * @brief Filesystem format version stored in the superblock.
- */
-#define FS_VERSION 1
-
 /**
  * @brief Logical block size used by this filesystem implementation (bytes).
  */
 #define BLOCK_SIZE 4096
 
 /**
- * @brief Fixed inode size assumption (bytes).
- *
- * Note: The actual struct pseudo_inode is packed; this constant is kept
- * for documentation/compatibility reference.
+ * @brief Size of one inode table entry on images with FS_FEATURE_EXTENTS (bytes).
  */
 #define INODE_SIZE 128
 
@@ -34,22 +26,138 @@
  */
 #define FS_INVALID_BLOCK ((uint32_t)UINT32_MAX)
 
+/**
+ * @brief Largest number of data blocks fs_format() will create.
+ *
+ * Block ids are passed around as int, so the count is capped at INT32_MAX
+ * (8 TiB of data with 4 KiB blocks).
+ */
+#define FS_MAX_BLOCKS ((uint64_t)INT32_MAX)
+
+/**
+ * @brief Inode flag: data is mapped by the extent tree rooted in the inode.
+ *
+ * Without it the inode uses direct_blocks/indirect_block.
+ */
+#define INODE_FLAG_EXTENTS 0x00000001u
+
+/**
+ * @brief Inode flag: directory entries live in hashed buckets (see dir_index.h).
+ *
+ * Without it a directory keeps all entries in its first data block.
+ */
+#define INODE_FLAG_DIR_INDEX 0x00000002u
+
+/**
+ * @brief Magic value identifying an extent tree node header.
+ */
+#define EXTENT_MAGIC 0xE7A1
+
+/**
+ * @brief Number of extent records stored inline in the inode.
+ */
+#define INODE_INLINE_EXTENTS 8
+
+/**
+ * @brief Header of an extent tree node (inline in the inode or at the start of a tree block).
+ */
+struct extent_header {
+    /** @brief EXTENT_MAGIC. */
+    uint16_t magic;
+
+    /** @brief Number of valid records following the header. */
+    uint16_t entries;
+
+    /** @brief Capacity of the node in records. */
+    uint16_t max;
+
+    /** @brief Levels below this node: 0 for a leaf holding data extents. */
+    uint16_t depth;
+} __attribute__((packed));
+
+/**
+ * @brief Extent tree record, sorted by logical block within a node.
+ *
+ * In a leaf it maps length file blocks starting at logical to the data
+ * blocks starting at start. In an index node start is the child node block,
+ * logical the first file block the child covers, and length is unused.
+ */
+struct extent_record {
+    /** @brief First file (logical) block covered. */
+    uint32_t logical;
+
+    /** @brief First physical data block, or child node block in index nodes. */
+    uint32_t start;
+
+    /** @brief Number of blocks in the run (leaf records only). */
+    uint32_t length;
+} __attribute__((packed));
+
 /**
  * @brief In-memory/on-disk inode structure (packed).
  *
- * Contains both addressing (direct/indirect blocks) and basic metadata.
+ * Stored as is on images with FS_FEATURE_EXTENTS; older images store
+ * struct pseudo_inode_legacy, converted by the inode cache on load and store.
  */
 struct pseudo_inode {
     /** @brief Inode identifier (index in inode table). */
     uint32_t id;
 
+    /** @brief INODE_FLAG_* bits. */
+    uint32_t flags;
+
     /** @brief File size in bytes (0 for empty, meaningful for regular files). */
+    uint64_t file_size;
+
+    /** @brief Link count (number of directory references). */
+    uint8_t amount_of_links;
+
+    /** @brief True if inode is a directory, false if regular file. */
+    bool is_directory;
+
+    /** @brief Global depth of the bucket index (directories with INODE_FLAG_DIR_INDEX). */
+    uint8_t dir_depth;
+
+    /** @brief Reserved, must be zero. */
+    uint8_t reserved[5];
+
+    union {
+        /* Pointer map, used without INODE_FLAG_EXTENTS */
+        struct {
+            /** @brief Direct block pointers (up to 5 blocks). */
+            uint32_t direct_blocks[5];
+
+            /** @brief Single-indirect block pointer (block contains uint32_t block ids). */
+            uint32_t indirect_block;
+        };
+
+        /* Extent map, used with INODE_FLAG_EXTENTS */
+        struct {
+            /** @brief Root node header of the extent tree. */
+            struct extent_header extent_root;
+
+            /** @brief Root node records: data extents, or index records if extent_root.depth > 0. */
+            struct extent_record extents[INODE_INLINE_EXTENTS];
+        };
+    };
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct pseudo_inode) == INODE_SIZE, "pseudo_inode must stay INODE_SIZE bytes");
+
+/**
+ * @brief Inode table entry of images without FS_FEATURE_EXTENTS (packed).
+ */
+struct pseudo_inode_legacy {
+    /** @brief Inode identifier (index in inode table). */
+    uint32_t id;
+
+    /** @brief File size in bytes. */
     uint32_t file_size;
 
     /** @brief Direct block pointers (up to 5 blocks). */
     uint32_t direct_blocks[5];
 
-    /** @brief Single-indirect block pointer (block contains uint32_t block ids). */
+    /** @brief Single-indirect block pointer. */
     uint32_t indirect_block;
 
     /** @brief Link count (number of directory references). */
@@ -57,7 +165,6 @@ struct pseudo_inode {
 
     /** @brief True if inode is a directory, false if regular file. */
     bool is_directory;
-
 } __attribute__((packed));
 
 /**
@@ -71,16 +178,58 @@ struct directory_item {
     uint32_t inode_id;
 } __attribute__((packed));
 
+/**
+ * @brief Magic value identifying a hashed directory bucket.
+ */
+#define DIR_BUCKET_MAGIC 0xB0C7
+
+/**
+ * @brief First slot of a hashed directory bucket (packed, same size as a directory_item).
+ */
+struct dir_bucket_header {
+    /** @brief DIR_BUCKET_MAGIC. */
+    uint16_t magic;
+
+    /** @brief Number of low hash bits shared by every entry in the bucket. */
+    uint8_t local_depth;
+
+    /** @brief Reserved, must be zero. */
+    uint8_t reserved[9];
+
+    /** @brief Always FS_INVALID_INODE, so entry scans see the slot as free. */
+    uint32_t inode_id;
+} __attribute__((packed));
+
+_Static_assert(sizeof(struct dir_bucket_header) == sizeof(struct directory_item), "bucket header must fill one slot");
+
+/**
+ * @brief Run of physically contiguous data blocks.
+ */
+struct block_extent {
+    /** @brief First block id of the run. */
+    uint32_t start;
+
+    /** @brief Number of blocks in the run. */
+    uint32_t length;
+};
+
 /**
  * @brief Initializes metadata caches derived from the mounted filesystem state.
  *
- * Reads superblock/bitmaps from disk-layer accessors and computes free counters.
+ * Reads superblock/bitmaps from disk-layer accessors, takes the free counters
+ * from a cleanly unmounted superblock (or recounts them with a popcount over
+ * the bitmaps), builds the free-space summaries and resets the block and
+ * inode caches.
  */
 void metadata_init(void);
 
 /**
  * @brief Allocates a free inode and marks it used in inode bitmap.
  *
+ * Next-fit: the search starts after the previously allocated inode and
+ * wraps around, descending the bitmap summary to the first word with a
+ * free bit.
+ *
  * @return Allocated inode id, or -1 if none available.
  */
 int allocate_free_inode(void);
@@ -95,10 +244,30 @@ void free_inode(int inode_id);
 /**
  * @brief Allocates a free data block and marks it used in block bitmap.
  *
+ * Next-fit: the search starts after the previously allocated block and
+ * wraps around, descending the bitmap summary to the first word with a
+ * free bit, so the cost stays logarithmic even on a nearly full filesystem.
+ *
  * @return Allocated block id, or -1 if none available.
  */
 int allocate_free_block(void);
 
+/**
+ * @brief Allocates count data blocks as few contiguous runs as possible.
+ *
+ * Starting at the next-fit cursor, free runs are examined until one covers
+ * all remaining blocks (or a bounded number of candidates has been seen, in
+ * which case the longest is taken) and the search repeats for the rest.
+ * Either every block is allocated or none is.
+ *
+ * @param count Number of blocks to allocate.
+ * @param out_extents Output array receiving the allocated runs in allocation order.
+ * @param max_extents Capacity of out_extents.
+ * @return Number of extents written, 0 if count is 0, or -1 if there is not
+ *         enough free space or the runs would not fit into max_extents.
+ */
+int allocate_free_blocks(uint32_t count, struct block_extent* out_extents, int max_extents);
+
 /**
  * @brief Frees a data block and clears its bit in the block bitmap.
  *
@@ -107,36 +276,163 @@ int allocate_free_block(void);
 void free_block(int block_id);
 
 /**
- * @brief Reads an inode from disk into the provided structure.
+ * @brief Frees length consecutive data blocks starting at start.
+ *
+ * @param start First block id.
+ * @param length Number of blocks.
+ */
+void free_block_run(uint32_t start, uint32_t length);
+
+/**
+ * @brief Reads an inode into the provided structure (through the inode cache).
  *
  * @param inode_id Inode id to read.
  * @param inode Output inode structure.
+ * @return true on success, false on I/O error.
  */
-void read_inode(int inode_id, struct pseudo_inode* inode);
+bool read_inode(int inode_id, struct pseudo_inode* inode);
 
 /**
- * @brief Writes an inode structure to disk at its inode table position.
+ * @brief Writes an inode structure to its inode table position.
+ *
+ * The write is held in the inode cache; repeated writes to one inode are
+ * merged and reach disk on eviction or at the next fs_sync().
  *
  * @param inode_id Inode id to write.
  * @param inode Inode structure to store.
+ * @return true on success, false on I/O error.
+ */
+bool write_inode(int inode_id, const struct pseudo_inode* inode);
+
+/**
+ * @brief Starts recording the data blocks written from now on, for sync_recorded_writes().
+ *
+ * Cached writes reach the container in block and inode-table order, not
+ * in the order they were made. Callers that need one update on disk
+ * before a later one (rename links the new name before dropping the old)
+ * record the first update and sync it before making the second.
+ */
+void record_block_writes(void);
+
+/**
+ * @brief Write barrier: puts the recorded blocks, their bitmap bits and one inode on disk.
+ *
+ * Only what the recorded update touched is written, not the whole block
+ * map of the inode. Stops recording; if more blocks were written than can
+ * be recorded, falls back to fs_sync().
+ *
+ * @param inode_id Inode id the update changed.
+ * @param inode Current inode contents.
+ * @return true on success, false on I/O error.
  */
-void write_inode(int inode_id, const struct pseudo_inode* inode);
+bool sync_recorded_writes(int inode_id, const struct pseudo_inode* inode);
 
 /**
- * @brief Reads a data block by block id.
+ * @brief Reads a data block by block id (through the block cache).
  *
  * @param block_id Block id to read.
  * @param buffer Output buffer of size BLOCK_SIZE.
+ * @return true on success, false on I/O error.
  */
-void read_block(int block_id, void* buffer);
+bool read_block(int block_id, void* buffer);
 
 /**
  * @brief Writes a data block by block id.
  *
+ * With the block cache enabled the data reaches the container on eviction
+ * or at the next fs_sync().
+ *
  * @param block_id Block id to write.
  * @param buffer Input buffer of size BLOCK_SIZE.
+ * @return true on success, false on I/O error.
+ */
+bool write_block(int block_id, const void* buffer);
+
+/**
+ * @brief Maximum number of blocks moved by a single read_blocks()/write_blocks() I/O.
+ */
+#define BLOCK_RUN_MAX_IO 1024
+
+/**
+ * @brief Reads count consecutive data blocks into buffer.
+ *
+ * Issues one container read per BLOCK_RUN_MAX_IO blocks instead of one per
+ * block; cached copies stay authoritative.
+ *
+ * @param start First block id.
+ * @param count Number of blocks.
+ * @param buffer Output buffer of count * BLOCK_SIZE bytes.
+ * @return true on success, false on I/O error.
+ */
+bool read_blocks(int start, uint32_t count, void* buffer);
+
+/**
+ * @brief Writes count consecutive data blocks from buffer.
+ *
+ * Issues one container write per BLOCK_RUN_MAX_IO blocks; cached copies are
+ * refreshed.
+ *
+ * @param start First block id.
+ * @param count Number of blocks.
+ * @param buffer Input buffer of count * BLOCK_SIZE bytes.
+ * @return true on success, false on I/O error.
+ */
+bool write_blocks(int start, uint32_t count, const void* buffer);
+
+/**
+ * @brief Copies bytes of consecutive data blocks to a host file descriptor.
+ *
+ * The kernel moves the data (see disk_copy_to_fd()); dirty cached copies
+ * are written back first.
+ *
+ * @param start First block id.
+ * @param bytes Number of bytes from the start of the first block (the last block may be partial).
+ * @param fd Host descriptor opened for writing.
+ * @param fd_offset Byte offset in fd to write at.
+ * @return true on success, false on I/O error.
+ */
+bool copy_blocks_to_fd(int start, uint64_t bytes, int fd, uint64_t fd_offset);
+
+/**
+ * @brief copy_blocks_to_fd() without the block cache, for concurrent readers.
+ *
+ * Nothing shared is modified, so several threads may call it at once. The
+ * caller must write dirty cached blocks back first (fs_sync()) and must not
+ * change the filesystem until all copies are done.
+ *
+ * @param start First block id.
+ * @param bytes Number of bytes from the start of the first block (the last block may be partial).
+ * @param fd Host descriptor opened for writing.
+ * @param fd_offset Byte offset in fd to write at.
+ * @return true on success, false on I/O error.
+ */
+bool copy_blocks_to_fd_direct(int start, uint64_t bytes, int fd, uint64_t fd_offset);
+
+/**
+ * @brief Copies bytes of a host file descriptor into consecutive data blocks.
+ *
+ * The kernel moves the data (see disk_copy_from_fd()); cached copies of the
+ * blocks are dropped first.
+ *
+ * @param fd Host descriptor opened for reading.
+ * @param fd_offset Byte offset in fd to read from.
+ * @param start First block id.
+ * @param bytes Number of bytes from the start of the first block (the last block may be partial).
+ * @return true on success, false on I/O error.
+ */
+bool copy_blocks_from_fd(int fd, uint64_t fd_offset, int start, uint64_t bytes);
+
+/**
+ * @brief Returns a read-only pointer to a data block without copying it.
+ *
+ * Points into the mapping in FS_MOUNT_MMAP mode, or into the block cache
+ * otherwise (valid only until the next block operation). Callers must fall
+ * back to read_block() when NULL is returned.
+ *
+ * @param block_id Block id to access.
+ * @return Pointer to BLOCK_SIZE bytes, or NULL if direct access is unavailable.
  */
-void write_block(int block_id, const void* buffer);
+const void* peek_block(int block_id);
 
 /**
  * @brief Returns current number of free data blocks (cached).
@@ -1,8 +1,23 @@
+#define _GNU_SOURCE
 #include "shell_layer.h"
+#include "tree_copy.h"
 #include "../logic/logic_layer.h"
+#include "../meta/block_cache.h"
+#include "../meta/inode_cache.h"
+#include "../logic/dentry_cache.h"
+#include "../meta/block_map.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/** @brief Bytes moved per step when copying file data (large enough for run-sized I/O). */
+#define IO_CHUNK_SIZE (256 * BLOCK_SIZE)
+
+/** @brief Bytes moved per step between a host file and the VFS; bounds the memory of incp/outcp. */
+#define HOST_CHUNK_SIZE (16 * BLOCK_SIZE)
 
 // Shell session state
 static char* current_path;   // Current working directory (absolute VFS path)
@@ -20,6 +35,7 @@ static int init(void) {
     }
 
     metadata_init();
+    logic_init();
     current_path = "/";
     return res;
 }
@@ -46,6 +62,28 @@ void run_shell(const char *filesystem_name) {
     }
 }
 
+// Parses a byte count with an optional binary unit suffix ("10", "4K", "10MB"); false on anything else
+static bool parse_size(const char* text, uint64_t* size) {
+    // strtoull() would accept a sign and wrap "-1" around to the largest value
+    if (text[0] < '0' || text[0] > '9') return false;
+
+    errno = 0;
+    char* end;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if (errno != 0) return false;
+
+    uint64_t unit = 1;
+    if (*end == 'K' || *end == 'k') unit = 1024ull;
+    else if (*end == 'M' || *end == 'm') unit = 1024ull * 1024;
+    else if (*end == 'G' || *end == 'g') unit = 1024ull * 1024 * 1024;
+    if (unit > 1) end++;
+    if (*end == 'B' || *end == 'b') end++;
+    if (*end != '\0' || value > UINT64_MAX / unit) return false;
+
+    *size = (uint64_t)value * unit;
+    return true;
+}
+
 void execute_command(const char* input) {
     // Parse up to 3 arguments (command + up to 3 parameters)
     char cmd[64], arg1[256], arg2[256], arg3[256];
@@ -88,6 +126,15 @@ void execute_command(const char* input) {
         else if (res == 3) printf("FILE TOO LARGE\n");
         else printf("UNKNOWN ERROR\n");
     }
+    else if (strcmp(cmd, "truncate") == 0) {
+        uint64_t size;
+        if (args < 3 || !parse_size(arg2, &size)) { printf("Usage: truncate s1 size[B|K|KB|M|MB|G|GB]\n"); return; }
+        const int res = fs_truncate(arg1, size);
+        if (res == 0) printf("OK\n");
+        else if (res == 1) printf("FILE NOT FOUND\n");
+        else if (res == 3) printf("FILE TOO LARGE\n");
+        else printf("UNKNOWN ERROR\n");
+    }
     else if (strcmp(cmd, "cp") == 0) {
         if (args < 3) { printf("Usage: cp s1 s2\n"); return; }
         const int res = fs_copy(arg1, arg2);
@@ -149,6 +196,14 @@ void execute_command(const char* input) {
         const int res = fs_info(arg1);
         if (res == 1) printf("FILE NOT FOUND\n");
     }
+    else if (strcmp(cmd, "incp") == 0 && args > 1 && strcmp(arg1, "-r") == 0) {
+        if (args < 4) { printf("Usage: incp -r a1 a2\n"); return; }
+        const int res = fs_import_tree(arg2, arg3);
+        if (res == 0) printf("OK\n");
+        else if (res == 1) printf("PATH NOT FOUND\n");
+        else if (res == 2) printf("EXIST\n");
+        else printf("INCOMPLETE\n");
+    }
     else if (strcmp(cmd, "incp") == 0) {
         if (args < 3) { printf("Usage: incp s1 s2\n"); return; }
         const int res = fs_import(arg1, arg2);
@@ -157,6 +212,14 @@ void execute_command(const char* input) {
         else if (res == 2) printf("PATH NOT FOUND\n");
         else printf("UNKNOWN ERROR\n");
     }
+    else if (strcmp(cmd, "outcp") == 0 && args > 1 && strcmp(arg1, "-r") == 0) {
+        if (args < 4) { printf("Usage: outcp -r a1 a2\n"); return; }
+        const int res = fs_export_tree(arg2, arg3);
+        if (res == 0) printf("OK\n");
+        else if (res == 1) printf("PATH NOT FOUND\n");
+        else if (res == 2) printf("CANNOT CREATE\n");
+        else printf("INCOMPLETE\n");
+    }
     else if (strcmp(cmd, "outcp") == 0) {
         if (args < 3) { printf("Usage: outcp s1 s2\n"); return; }
         const int res = fs_export(arg1, arg2);
@@ -190,37 +253,51 @@ void execute_command(const char* input) {
     }
 }
 
+// Appends the whole content of src_inode to dest_inode, one chunk at a time
+static int append_file_data(const int src_inode, const int dest_inode) {
+    char* chunk = malloc(IO_CHUNK_SIZE);
+    struct file_handle* out = file_open(dest_inode);
+
+    // Appending a file to itself: a second handle would keep the map from before the appends
+    // grew or split it, so read through the writing one; the size below is taken first
+    struct file_handle* in = src_inode == dest_inode ? out : file_open(src_inode);
+    int res = (chunk && in && out) ? 0 : -1;
+
+    const uint64_t size = in ? in->inode.file_size : 0;
+    for (uint64_t done = 0; res == 0 && done < size;) {
+        const uint64_t want = (size - done < IO_CHUNK_SIZE) ? size - done : IO_CHUNK_SIZE;
+        const int64_t got = file_pread(in, chunk, want, done);
+        if (got <= 0 || file_append(out, chunk, (uint64_t)got) != got) {
+            res = -1;
+            break;
+        }
+        done += (uint64_t)got;
+    }
+
+    if (!file_close(out)) res = -1;
+    if (in != out) file_close(in);
+    free(chunk);
+    return res;
+}
+
 int fs_copy(char* src, char* dest) {
     src = complete_path(src);
     dest = complete_path(dest);
 
-    char parent_path[MAX_PATH_LEN], src_name[FILENAME_MAX];
-    if (!split_path(src, parent_path, src_name)) return 1;
-
-    const int src_node = find_inode_by_path(src);
-
-    if (src_node < 0) return 1;
-    if (is_directory(src_node)) return 1;
-
-    char dest_parent_path[MAX_PATH_LEN], dest_name[FILENAME_MAX];
-    if (!split_path(dest, dest_parent_path, dest_name)) return 1;
-
-    const int dest_parent_node = find_inode_by_path(dest_parent_path);
+    struct pseudo_inode src_inode;
+    const int src_node = lookup_path(src, &src_inode);
+    if (src_node < 0 || src_inode.is_directory) return 1;
 
+    char dest_name[MAX_FILENAME_LEN];
+    const int dest_parent_node = resolve_parent(dest, dest_name);
     if (dest_parent_node < 0) return 2;
 
-    int new_inode_id = create_file(dest_parent_node, dest_name, false);
+    const int new_inode_id = create_at(dest_parent_node, dest_name, false);
     if (new_inode_id < 0) return 3;
 
-    void* buffer = malloc(MAX_FILE_SIZE);
-
-    int bytes_read = read_inode_data(src_node, buffer);
-
-    int bytes_written = write_inode_data(new_inode_id, buffer, bytes_read);
-
-    if (bytes_written != bytes_read)
+    if (append_file_data(src_node, new_inode_id) != 0)
     {
-        printf("WRITE ERROR (%d != %d)\n", bytes_written, bytes_read);
+        printf("WRITE ERROR\n");
         return 3;
     }
 
@@ -232,58 +309,41 @@ int fs_move(char* src, char* dest) {
     src = complete_path(src);
     dest = complete_path(dest);
 
-    if (path_exists(dest)) return 2;
-
-    char parent_path[MAX_PATH_LEN], src_name[FILENAME_MAX];
-    if (!split_path(src, parent_path, src_name)) return 1;
-
-    const int src_node = find_inode_by_path(src);
+    char src_name[MAX_FILENAME_LEN], dest_name[MAX_FILENAME_LEN];
+    const int src_parent_node = resolve_parent(src, src_name);
+    if (src_parent_node < 0) return 1;
 
-    char dest_parent_path[MAX_PATH_LEN], dest_name[FILENAME_MAX];
-    if (!split_path(dest, dest_parent_path, dest_name)) return 1;
-
-    const int dest_parent_node = find_inode_by_path(dest_parent_path);
-
-    if (src_node < 0) return 1;
+    const int dest_parent_node = resolve_parent(dest, dest_name);
     if (dest_parent_node < 0) return 2;
-    if (!is_directory(dest_parent_node)) return 2;
-
-    // Use logical AND (not bitwise) to combine boolean results
-    if (add_directory_item(dest_parent_node, dest_name, src_node) &&
-        remove_directory_item(find_inode_by_path(parent_path), src_name)) {
-        return 0;
-    }
 
-    return 3;
+    // Same codes: 1 source missing, 2 destination exists, 3 update failed
+    return rename_at(src_parent_node, src_name, dest_parent_node, dest_name);
 }
 
 int fs_remove(char* path) {
     // rm removes only regular files; directories are handled by rmdir.
     path = complete_path(path);
 
-    const int node_id = find_inode_by_path(path);
-    if (node_id < 0) return 1;
-
-    if (is_directory(node_id)) return 2;
+    char name[MAX_FILENAME_LEN];
+    const int parent_node = resolve_parent(path, name);
+    if (parent_node < 0) return 1;
 
-    return delete_file(path);
+    return unlink_at(parent_node, name, false);
 }
 
 int fs_mkdir(char* path) {
     // Create a directory and link it into its parent directory.
     path = complete_path(path);
 
-    if (path_exists(path)) return 2; // directory already exists
+    if (strcmp("/", path) == 0) return 2; // root always exists
 
-    char parent_path[MAX_PATH_LEN];
     char dir_name[MAX_FILENAME_LEN];
-
-    if (!split_path(path, parent_path, dir_name)) return 1;
-
-    const int parent_node = find_inode_by_path(parent_path);
+    const int parent_node = resolve_parent(path, dir_name);
     if (parent_node < 0) return 1;
 
-    const int new_inode = create_file(parent_node, dir_name, true);
+    if (lookup_at(parent_node, dir_name, NULL) >= 0) return 2; // directory already exists
+
+    const int new_inode = create_at(parent_node, dir_name, true);
     return (new_inode >= 0) ? 0 : 1;
 }
 
@@ -295,15 +355,12 @@ int fs_rmdir(char* path) {
         return 2;
     }
 
-    const int node_id = find_inode_by_path(path);
-
-    if (node_id < 0) return 1;
-
-    if (!is_directory(node_id)) return 2;
-
-    if (!is_directory_empty(node_id)) return 2;
+    char name[MAX_FILENAME_LEN];
+    const int parent_node = resolve_parent(path, name);
+    if (parent_node < 0) return 1;
 
-    return delete_file(path);
+    // 2 also covers a file or a non-empty directory
+    return unlink_at(parent_node, name, true);
 }
 
 int fs_ls(char* path) {
@@ -312,9 +369,10 @@ int fs_ls(char* path) {
     } else {
         path = complete_path(path);
     }
-    const int node_id = find_inode_by_path(path);
+    struct pseudo_inode inode;
+    const int node_id = lookup_path(path, &inode);
     if (node_id < 0) return 1;
-    if (is_directory(node_id)) {
+    if (inode.is_directory) {
         printf("Containment of %s:\n", path);
         list_directory(node_id);
         return 0;
@@ -327,38 +385,40 @@ int fs_cat(char* path) {
     path = complete_path(path);
 
     // Locate inode
-    const int inode_id = find_inode_by_path(path);
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(path, &inode);
     if (inode_id < 0) return 1;
-    if (is_directory(inode_id)) return 1;
+    if (inode.is_directory) return 1;
 
-    // Read file content
-    char* buffer = (char*)malloc(MAX_FILE_SIZE + 1);
-    if (!buffer) {
-        printf("MEMORY ERROR\n");
-        return 1;
-    }
+    struct file_handle* fh = file_open(inode_id);
+    if (!fh) return 1;
 
-    const int read_bytes = read_inode_data(inode_id, buffer);
-    if (read_bytes < 0) {
-        free(buffer);
-        return 1;
+    // One block at a time, written as bytes: NULs pass through and output starts with the first block
+    char block[BLOCK_SIZE];
+    const uint64_t size = fh->inode.file_size;
+    uint64_t done = 0;
+    while (done < size) {
+        const int64_t got = file_pread(fh, block, BLOCK_SIZE, done);
+        if (got <= 0 || fwrite(block, 1, (size_t)got, stdout) != (size_t)got) break;
+        done += (uint64_t)got;
     }
+    printf("\n");
+    fflush(stdout);
 
-    buffer[read_bytes] = '\0';
-    printf("%s\n", buffer);
-
-    free(buffer);
-    return 0;
+    file_close(fh);
+    // A failed read or write leaves the output short
+    return done < size ? 1 : 0;
 }
 
 int fs_cd(char* path) {
 
     path = complete_path(path);
 
-    int inode_id = find_inode_by_path(path);
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(path, &inode);
 
     if (inode_id < 0) return 1;
-    if (!is_directory(inode_id)) return 2;
+    if (!inode.is_directory) return 2;
 
     current_path = strdup(path);
     return 0;
@@ -368,29 +428,40 @@ void fs_pwd(void* buffer) {
     buffer = current_path;
 }
 
+// block_map_walk() visitor for fs_info: one line per extent
+static void print_extent(void* ctx, const uint32_t logical, const uint32_t start, const uint32_t length) {
+    (*(int*)ctx)++;
+    printf("    blocks %u-%u -> #%u-#%u\n", logical, logical + length - 1, start, start + length - 1);
+}
+
 int fs_info(char* path) {
     // Print basic inode info and referenced blocks.
     path = complete_path(path);
 
-    const int inode_id = find_inode_by_path(path);
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(path, &inode);
     if (inode_id < 0) {
         printf("FILE NOT FOUND\n");
         return 1;
     }
 
-    struct pseudo_inode inode;
-    read_inode(inode_id, &inode);
-
     // Extract basename for display
     const char* name = strrchr(path, '/');
     name = name ? (name + 1) : path;
     if (name[0] == '\0') name = "/";
 
-    const int file_size = (int)inode.file_size;
-
-    printf("%s - %d B - i-node %d - ", name, file_size, inode_id);
+    printf("%s - %llu B - i-node %d - ", name, (unsigned long long)inode.file_size, inode_id);
     printf(inode.is_directory ? "DIRECTORY\n" : "FILE\n");
 
+    if (inode.flags & INODE_FLAG_EXTENTS) {
+        printf("  Extent tree depth: %u\n", inode.extent_root.depth);
+        printf("  Extents:\n");
+        int extents = 0;
+        block_map_walk(&inode, print_extent, &extents);
+        if (!extents) printf("    none\n");
+        return 0;
+    }
+
     printf("  Direct blocks: ");
     int has_direct = 0;
     for (int i = 0; i < 5; i++) {
@@ -423,118 +494,199 @@ int fs_info(char* path) {
     return 0;
 }
 
-int fs_import(const char* src, const char* dest) {
-    // Import a host file into VFS as a regular file.
-    FILE* src_file = fopen(src, "rb");
-    if (!src_file) {
-        return 1;
+bool fs_import_fd(struct file_handle* fh, const int fd, const uint64_t size) {
+    // The kernel moves the data; host holes stay holes
+    uint64_t pos = 0;
+    while (pos < size) {
+        off_t data = lseek(fd, (off_t)pos, SEEK_DATA);
+        if (data < 0 && errno == ENXIO) break; // Only a hole is left
+
+        // Without SEEK_DATA support the rest is treated as data
+        off_t hole = data < 0 ? (off_t)size : lseek(fd, data, SEEK_HOLE);
+        if (data < 0) data = (off_t)pos;
+        if (hole < 0 || (uint64_t)hole > size) hole = (off_t)size;
+
+        // Whole blocks: the host reads zeros around a data segment anyway
+        const uint64_t start = (uint64_t)data / BLOCK_SIZE * BLOCK_SIZE;
+        uint64_t end = ((uint64_t)hole + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+        if (end > size) end = size;
+
+        if (file_copy_from_fd(fh, fd, start, end - start) < 0) return false;
+        pos = end;
     }
 
-    // Determine host file size
-    fseek(src_file, 0, SEEK_END);
-    long file_size = ftell(src_file);
-    fseek(src_file, 0, SEEK_SET);
+    // A trailing hole only sets the size
+    return file_truncate(fh, size);
+}
 
-    if (file_size <= 0) {
-        printf("EMPTY OR INVALID FILE\n");
-        fclose(src_file);
+// Streams a host file of unknown size (pipe, device) into an empty VFS file; 0 or an fs_import() code
+static int import_stream(struct file_handle* fh, FILE* src_file) {
+    char* chunk = malloc(HOST_CHUNK_SIZE);
+    if (!chunk) {
+        printf("MEMORY ERROR\n");
         return 1;
     }
 
-    if (file_size > MAX_FILE_SIZE) {
-        printf("FILE TOO LARGE (max %lu bytes)\n", (unsigned long)MAX_FILE_SIZE);
-        fclose(src_file);
-        return 1;
+    int res = 0;
+    uint64_t written = 0;
+    size_t n;
+    while (res == 0 && (n = fread(chunk, 1, HOST_CHUNK_SIZE, src_file)) > 0) {
+        if (written + n > max_file_size()) {
+            printf("FILE TOO LARGE (max %llu bytes)\n", (unsigned long long)max_file_size());
+            res = 1;
+        } else if (file_pwrite(fh, chunk, n, written) != (int64_t)n) {
+            printf("WRITE FAILED after %llu bytes\n", (unsigned long long)written);
+            res = 2;
+        } else {
+            written += n;
+        }
     }
+    free(chunk);
 
-    // Basic capacity check (rough, based on blocks)
-    if ((file_size + (BLOCK_SIZE - 1)) / BLOCK_SIZE > (long)get_amount_of_available_blocks()) {
-        printf("NOT ENOUGH SPACE IN FILESYSTEM\n");
-        fclose(src_file);
-        return 1;
+    if (res == 0 && ferror(src_file)) {
+        printf("READ FAILED after %llu bytes\n", (unsigned long long)written);
+        res = 1;
+    } else if (res == 0 && written == 0) {
+        printf("EMPTY OR INVALID FILE\n");
+        res = 1;
     }
+    return res;
+}
 
-    // Read host file into memory
-    void* buffer = malloc((size_t)file_size);
-    if (!buffer) {
-        printf("MEMORY ERROR\n");
-        fclose(src_file);
+int fs_import(const char* src, const char* dest) {
+    // Import a host file into VFS as a regular file.
+    FILE* src_file = fopen(src, "rb");
+    if (!src_file) {
         return 1;
     }
 
-    fread(buffer, 1, (size_t)file_size, src_file);
-    fclose(src_file);
-
-    dest = complete_path((char*)dest);
+    // The chunk is the only buffer; stdio buffering would add a copy of every byte
+    setvbuf(src_file, NULL, _IONBF, 0);
 
-    // Destination inside VFS must not already exist
-    if (path_exists(dest)) {
-        free(buffer);
-        return 2;
+    // A regular file's size is checked up front; pipes and devices while streaming
+    struct stat st;
+    const bool regular = fstat(fileno(src_file), &st) == 0 && S_ISREG(st.st_mode);
+    if (regular) {
+        if (st.st_size == 0) {
+            printf("EMPTY OR INVALID FILE\n");
+            fclose(src_file);
+            return 1;
+        }
+        if ((uint64_t)st.st_size > max_file_size()) {
+            printf("FILE TOO LARGE (max %llu bytes)\n", (unsigned long long)max_file_size());
+            fclose(src_file);
+            return 1;
+        }
     }
 
-    // Resolve destination parent directory and filename
-    char parent_path[MAX_PATH_LEN];
-    char vfs_name[MAX_FILENAME_LEN];
+    // No capacity pre-check: holes are kept, so the host size can overstate the need
 
-    if (!split_path(dest, parent_path, vfs_name)) {
-        free(buffer);
-        return 2;
-    }
+    dest = complete_path((char*)dest);
 
-    const int parent_inode = find_inode_by_path(parent_path);
-    if (parent_inode < 0 || !is_directory(parent_inode)) {
-        free(buffer);
+    // Resolve destination parent directory and filename; the destination must not exist yet
+    char vfs_name[MAX_FILENAME_LEN];
+    const int parent_inode = resolve_parent(dest, vfs_name);
+    if (parent_inode < 0 || lookup_at(parent_inode, vfs_name, NULL) >= 0) {
+        fclose(src_file);
         return 2;
     }
 
     // Create destination file inode and write data
-    const int new_inode = create_file(parent_inode, vfs_name, false);
+    const int new_inode = create_at(parent_inode, vfs_name, false);
     if (new_inode < 0) {
         printf("FAILED TO CREATE\n");
-        free(buffer);
+        fclose(src_file);
         return 2;
     }
 
-    const int written = write_inode_data(new_inode, buffer, (int)file_size);
-    free(buffer);
-
-    if (written != (int)file_size) {
-        printf("WRITE FAILED %d != %ld\n", written, file_size);
-        return 2;
+    struct file_handle* fh = file_open(new_inode);
+    int res = fh ? 0 : 2;
+    if (res == 0 && regular) {
+        // Regular host file: copied by the kernel straight into the data blocks
+        if (!fs_import_fd(fh, fileno(src_file), (uint64_t)st.st_size)) {
+            printf("WRITE FAILED\n");
+            res = 2;
+        }
+    } else if (res == 0) {
+        res = import_stream(fh, src_file);
     }
 
-    return 0;
+    if (!file_close(fh) && res == 0) res = 2;
+    fclose(src_file);
+
+    // Do not leave a partial file behind
+    if (res != 0) unlink_at(parent_inode, vfs_name, false);
+    return res;
+}
+
+int fs_import_tree(const char* src, const char* dest) {
+    // Import a host directory tree into VFS under a new directory.
+    struct stat st;
+    if (stat(src, &st) != 0 || !S_ISDIR(st.st_mode)) return 1;
+
+    dest = complete_path((char*)dest);
+
+    char vfs_name[MAX_FILENAME_LEN];
+    const int parent_inode = resolve_parent(dest, vfs_name);
+    if (parent_inode < 0 || lookup_at(parent_inode, vfs_name, NULL) >= 0) return 2;
+
+    return tree_import(src, parent_inode, vfs_name);
 }
 
 int fs_export(const char* src, const char* dest) {
     // Export a VFS file to the host filesystem.
     src = complete_path((char*)src);
 
-    const int inode_id = find_inode_by_path(src);
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(src, &inode);
     if (inode_id < 0) return 1;
-    if (is_directory(inode_id)) return 1;
+    if (inode.is_directory) return 1;
 
-    void* buffer = malloc(MAX_FILE_SIZE);
-    if (!buffer) return 2;
-
-    const int bytes_read = read_inode_data(inode_id, buffer);
-    if (bytes_read <= 0) {
-        free(buffer);
-        return 2;
-    }
+    struct file_handle* fh = file_open(inode_id);
+    if (!fh) return 2;
 
     FILE* dest_file = fopen(dest, "wb");
     if (!dest_file) {
-        free(buffer);
+        file_close(fh);
         return 2;
     }
+    setvbuf(dest_file, NULL, _IONBF, 0);
+
+    const uint64_t size = fh->inode.file_size;
+    bool ok;
+    struct stat st;
+    if (fstat(fileno(dest_file), &st) == 0 && S_ISREG(st.st_mode)) {
+        // Regular host file: sized first so skipped holes read as zeros, then filled by the kernel
+        ok = ftruncate(fileno(dest_file), (off_t)size) == 0 && file_copy_to_fd(fh, fileno(dest_file)) == (int64_t)size;
+    } else {
+        // Pipe or device: stream through one fixed-size chunk
+        char* chunk = malloc(HOST_CHUNK_SIZE);
+        uint64_t done = 0;
+        while (chunk && done < size) {
+            const uint64_t want = (size - done < HOST_CHUNK_SIZE) ? size - done : HOST_CHUNK_SIZE;
+            const int64_t got = file_pread(fh, chunk, want, done);
+            if (got <= 0 || fwrite(chunk, 1, (size_t)got, dest_file) != (size_t)got) break;
+            done += (uint64_t)got;
+        }
+        free(chunk);
+        ok = done == size;
+    }
+
+    if (fclose(dest_file) != 0) ok = false;
+    file_close(fh);
 
-    const size_t written = fwrite(buffer, 1, (size_t)bytes_read, dest_file);
-    fclose(dest_file);
-    free(buffer);
+    return ok ? 0 : 2;
+}
+
+int fs_export_tree(const char* src, const char* dest) {
+    // Export a VFS directory tree to a new host directory.
+    src = complete_path((char*)src);
+
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(src, &inode);
+    if (inode_id < 0 || !inode.is_directory) return 1;
 
-    return (written == (size_t)bytes_read) ? 0 : 2;
+    return tree_export(inode_id, dest);
 }
 
 int fs_load_script(const char* filename) {
@@ -585,6 +737,7 @@ int fs_format_cmd(const int size) {
     }
 
     metadata_init();
+    logic_init();
     current_path = "/";
 
     return 0;
@@ -605,8 +758,8 @@ void fs_stat() {
     uint32_t free_blocks_count = get_amount_of_available_blocks();
     uint32_t free_inodes_count = get_amount_of_available_inodes();
 
-    uint32_t used_blocks = sb->total_blocks - free_blocks_count;
-    uint32_t used_inodes = sb->total_inodes - free_inodes_count;
+    uint32_t used_blocks = (uint32_t)sb->total_blocks - free_blocks_count;
+    uint32_t used_inodes = (uint32_t)sb->total_inodes - free_inodes_count;
 
     uint32_t dir_count = 0;
     const uint8_t* inode_bm = fs_get_inode_bitmap();
@@ -625,18 +778,20 @@ void fs_stat() {
     double size_mb = total_size / (1024.0 * 1024.0);
 
     printf("=== Filesystem Statistics ===\n");
-    printf("Total size:        %.2f MB (%lu bytes)\n", size_mb, total_size);
+    printf("Total size:        %.2f MB (%llu bytes)\n", size_mb, (unsigned long long)total_size);
     printf("Block size:        %u bytes\n", sb->block_size);
+    printf("Format version:    %u\n", sb->version);
+    printf("Inode format:      %s\n", (sb->features & FS_FEATURE_EXTENTS) ? "extents" : "block pointers");
     printf("\n");
     printf("Blocks:\n");
-    printf("  Total:           %u\n", sb->total_blocks);
+    printf("  Total:           %llu\n", (unsigned long long)sb->total_blocks);
     printf("  Used:            %u (%.2f%%)\n", used_blocks,
            (used_blocks * 100.0) / sb->total_blocks);
     printf("  Free:            %u (%.2f%%)\n", free_blocks_count,
            (free_blocks_count * 100.0) / sb->total_blocks);
     printf("\n");
     printf("Inodes:\n");
-    printf("  Total:           %u\n", sb->total_inodes);
+    printf("  Total:           %llu\n", (unsigned long long)sb->total_inodes);
     printf("  Used:            %u (%.2f%%)\n", used_inodes,
            (used_inodes * 100.0) / sb->total_inodes);
     printf("  Free:            %u (%.2f%%)\n", free_inodes_count,
@@ -644,6 +799,43 @@ void fs_stat() {
     printf("\n");
     printf("Directories:       %u\n", dir_count);
     printf("Files:             %u\n", used_inodes - dir_count);
+
+    struct block_cache_stats cache;
+    block_cache_get_stats(&cache);
+    const uint64_t lookups = cache.hits + cache.misses;
+
+    printf("\n");
+    printf("Block cache:\n");
+    printf("  Capacity:        %u blocks (%u resident)\n", cache.capacity, cache.resident);
+    printf("  Hits:            %llu (%.2f%%)\n", (unsigned long long)cache.hits,
+           lookups ? (cache.hits * 100.0) / lookups : 0.0);
+    printf("  Misses:          %llu\n", (unsigned long long)cache.misses);
+    printf("  Evictions:       %llu\n", (unsigned long long)cache.evictions);
+    printf("  Write-backs:     %llu\n", (unsigned long long)cache.writebacks);
+
+    struct inode_cache_stats icache;
+    inode_cache_get_stats(&icache);
+    const uint64_t ilookups = icache.hits + icache.misses;
+
+    printf("\n");
+    printf("Inode cache:\n");
+    printf("  Capacity:        %u inodes\n", icache.capacity);
+    printf("  Hits:            %llu (%.2f%%)\n", (unsigned long long)icache.hits,
+           ilookups ? (icache.hits * 100.0) / ilookups : 0.0);
+    printf("  Misses:          %llu\n", (unsigned long long)icache.misses);
+    printf("  Write-backs:     %llu\n", (unsigned long long)icache.writebacks);
+
+    struct dentry_cache_stats dcache;
+    dentry_cache_get_stats(&dcache);
+    const uint64_t dlookups = dcache.hits + dcache.negative_hits + dcache.misses;
+
+    printf("\n");
+    printf("Dentry cache:\n");
+    printf("  Capacity:        %u entries\n", dcache.capacity);
+    printf("  Hits:            %llu (%.2f%%)\n", (unsigned long long)dcache.hits,
+           dlookups ? (dcache.hits * 100.0) / dlookups : 0.0);
+    printf("  Negative hits:   %llu\n", (unsigned long long)dcache.negative_hits);
+    printf("  Misses:          %llu\n", (unsigned long long)dcache.misses);
 }
 
 char* complete_path(char* path) {
@@ -679,61 +871,34 @@ int fs_xcp(char* s1, char* s2, char* s3) {
     s2 = complete_path(s2);
     s3 = complete_path(s3);
 
-    const int s1_node = find_inode_by_path(s1);
-    const int s2_node = find_inode_by_path(s2);
+    struct pseudo_inode in1, in2;
+    const int s1_node = lookup_path(s1, &in1);
+    const int s2_node = lookup_path(s2, &in2);
     if (s1_node < 0 || s2_node < 0) return 1;
-    if (is_directory(s1_node) || is_directory(s2_node)) return 1;
+    if (in1.is_directory || in2.is_directory) return 1;
 
     // Validate destination: parent directory must exist and s3 must not exist
-    char s3_parent[MAX_PATH_LEN], s3_name[MAX_FILENAME_LEN];
-    if (!split_path(s3, s3_parent, s3_name)) return 2;
-
-    const int s3_parent_node = find_inode_by_path(s3_parent);
-    if (s3_parent_node < 0 || !is_directory(s3_parent_node)) return 2;
-    if (path_exists(s3)) return 2;
-
-    // Read both sources into memory and build output buffer
-    void* buf1 = malloc(MAX_FILE_SIZE);
-    void* buf2 = malloc(MAX_FILE_SIZE);
-    void* out  = malloc(MAX_FILE_SIZE);
-    if (!buf1 || !buf2 || !out) {
-        free(buf1); free(buf2); free(out);
-        return 4;
-    }
-
-    const int n1 = read_inode_data(s1_node, buf1);
-    const int n2 = read_inode_data(s2_node, buf2);
-    if (n1 < 0 || n2 < 0) {
-        free(buf1); free(buf2); free(out);
-        return 1;
-    }
+    char s3_name[MAX_FILENAME_LEN];
+    const int s3_parent_node = resolve_parent(s3, s3_name);
+    if (s3_parent_node < 0) return 2;
+    if (lookup_at(s3_parent_node, s3_name, NULL) >= 0) return 2;
+
+    const uint64_t n1 = in1.file_size;
+    const uint64_t n2 = in2.file_size;
 
     // Enforce max file size for the destination
-    if ((long long)n1 + (long long)n2 > (long long)MAX_FILE_SIZE) {
-        free(buf1); free(buf2); free(out);
-        return 3;
-    }
+    if (n1 + n2 > max_file_size()) return 3;
 
     // Rough capacity check
-    if ((long long)n1 + (long long)n2 > (long long)get_amount_of_available_blocks() * (long long)BLOCK_SIZE) {
-        free(buf1); free(buf2); free(out);
-        return 3;
-    }
+    if (n1 + n2 > (uint64_t)get_amount_of_available_blocks() * BLOCK_SIZE) return 3;
 
-    memcpy(out, buf1, (size_t)n1);
-    memcpy((char*)out + n1, buf2, (size_t)n2);
+    // Create destination file and stream both sources into it
+    const int new_inode_id = create_at(s3_parent_node, s3_name, false);
+    if (new_inode_id < 0) return 4;
 
-    // Create destination file and write concatenated data
-    const int new_inode_id = create_file(s3_parent_node, s3_name, false);
-    if (new_inode_id < 0) {
-        free(buf1); free(buf2); free(out);
-        return 4;
-    }
-
-    const int written = write_inode_data(new_inode_id, out, n1 + n2);
-
-    free(buf1); free(buf2); free(out);
-    return (written == n1 + n2) ? 0 : 4;
+    if (append_file_data(s1_node, new_inode_id) != 0) return 4;
+    if (append_file_data(s2_node, new_inode_id) != 0) return 4;
+    return 0;
 }
 
 int fs_add(char* s1, char* s2) {
@@ -741,43 +906,32 @@ int fs_add(char* s1, char* s2) {
     s1 = complete_path(s1);
     s2 = complete_path(s2);
 
-    const int s1_node = find_inode_by_path(s1);
-    const int s2_node = find_inode_by_path(s2);
+    struct pseudo_inode in1, in2;
+    const int s1_node = lookup_path(s1, &in1);
+    const int s2_node = lookup_path(s2, &in2);
     if (s1_node < 0 || s2_node < 0) return 1;
-    if (is_directory(s1_node) || is_directory(s2_node)) return 1;
-
-    void* buf1 = malloc(MAX_FILE_SIZE);
-    void* buf2 = malloc(MAX_FILE_SIZE);
-    void* out  = malloc(MAX_FILE_SIZE);
-    if (!buf1 || !buf2 || !out) {
-        free(buf1); free(buf2); free(out);
-        return 4;
-    }
+    if (in1.is_directory || in2.is_directory) return 1;
 
-    // Read both files and rewrite s1 with the concatenated buffer
-    const int n1 = read_inode_data(s1_node, buf1);
-    const int n2 = read_inode_data(s2_node, buf2);
-    if (n1 < 0 || n2 < 0) {
-        free(buf1); free(buf2); free(out);
-        return 1;
-    }
+    const uint64_t size1 = in1.file_size;
+    const uint64_t size2 = in2.file_size;
+    if (size1 + size2 > max_file_size()) return 3;
 
-    if ((long long)n1 + (long long)n2 > (long long)MAX_FILE_SIZE) {
-        free(buf1); free(buf2); free(out);
-        return 3;
-    }
+    // Rough capacity check for the blocks the append adds
+    const uint64_t new_blocks = (size1 + size2 + BLOCK_SIZE - 1) / BLOCK_SIZE - (size1 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if (new_blocks > get_amount_of_available_blocks()) return 3;
 
-    // Rough capacity check for additional data only
-    if ((long long)n2 > (long long)get_amount_of_available_blocks() * (long long)BLOCK_SIZE) {
-        free(buf1); free(buf2); free(out);
-        return 3;
-    }
+    // Append in place: s1 keeps its blocks, only the tail block and new blocks are written
+    return append_file_data(s2_node, s1_node) == 0 ? 0 : 4;
+}
 
-    memcpy(out, buf1, (size_t)n1);
-    memcpy((char*)out + n1, buf2, (size_t)n2);
+int fs_truncate(char* s1, const uint64_t size) {
+    // Set the size of s1, freeing blocks past a smaller size (within VFS).
+    s1 = complete_path(s1);
 
-    const int written = write_inode_data(s1_node, out, n1 + n2);
+    struct pseudo_inode inode;
+    const int inode_id = lookup_path(s1, &inode);
+    if (inode_id < 0 || inode.is_directory) return 1;
+    if (size > max_file_size()) return 3;
 
-    free(buf1); free(buf2); free(out);
-    return (written == n1 + n2) ? 0 : 4;
+    return truncate_inode(inode_id, size) ? 0 : 4;
 }
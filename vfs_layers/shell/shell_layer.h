@@ -118,6 +118,31 @@ int fs_info(char *path);
  */
 int fs_import(const char *src, const char *dest);
 
+/**
+ * @brief Imports a host directory tree into VFS: incp -r host_dir vfs_dest
+ *
+ * Files are read by a pool of worker threads; see tree_import().
+ *
+ * @param src Host directory.
+ * @param dest VFS path of the new directory; its parent must exist, it must not.
+ * @return 0 on success, 1 if src is not a readable directory, 2 if dest
+ *         cannot be created, 3 if some entries were skipped or failed.
+ */
+int fs_import_tree(const char *src, const char *dest);
+
+/**
+ * @brief Copies a regular host file into an empty VFS file.
+ *
+ * Only the host's data segments are copied (by the kernel, see
+ * file_copy_from_fd()); host holes stay holes and the size is set last.
+ *
+ * @param fh Handle of the empty destination file.
+ * @param fd Host descriptor opened for reading.
+ * @param size Host file size.
+ * @return true on success, false on I/O error or lack of space.
+ */
+bool fs_import_fd(struct file_handle *fh, int fd, uint64_t size);
+
 /**
  * @brief Exports a VFS file to host: outcp vfs_src host_dest
  *
@@ -127,6 +152,18 @@ int fs_import(const char *src, const char *dest);
  */
 int fs_export(const char *src, const char *dest);
 
+/**
+ * @brief Exports a VFS directory tree to host: outcp -r vfs_dir host_dest
+ *
+ * File data is copied by a pool of worker threads; see tree_export().
+ *
+ * @param src VFS directory.
+ * @param dest Host directory to create; its parent must exist, it must not.
+ * @return 0 on success, 1 if src is not a directory, 2 if dest cannot be
+ *         created, 3 if some entries could not be copied.
+ */
+int fs_export_tree(const char *src, const char *dest);
+
 /**
  * @brief Loads commands from a host file and executes them sequentially: load s1
  *
@@ -177,4 +214,15 @@ int fs_xcp(char* s1, char* s2, char* s3);
  */
 int fs_add(char* s1, char* s2);
 
+/**
+ * @brief Sets the size of a file inside VFS: truncate s1 size
+ *
+ * A smaller size frees the blocks past it; a larger size adds zeros.
+ *
+ * @param s1 File path.
+ * @param size New size in bytes.
+ * @return 0 on success, otherwise non-zero.
+ */
+int fs_truncate(char* s1, uint64_t size);
+
 #endif // SHELL_LAYER_H
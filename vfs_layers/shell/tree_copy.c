@@ -0,0 +1,582 @@
+#define _POSIX_C_SOURCE 200809L // Not _GNU_SOURCE: <fcntl.h> would then declare its own struct file_handle
+#include "tree_copy.h"
+#include "shell_layer.h"
+#include "../meta/block_map.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* One host entry in walk order; file fields below `ready` are filled in by a worker */
+struct import_entry {
+    char* host_path;                // Host path (owned)
+    int parent;                     // Index of the parent directory entry, -1 for the tree root
+    char name[MAX_FILENAME_LEN];    // Name inside the VFS
+    bool is_directory;
+    int inode_id;                   // Directory: its VFS inode once created, -1 if that failed
+    bool ready;                     // File loaded (guarded by the pool lock)
+    int error;                      // errno of a failed open/read, 0 otherwise
+    char* data;                     // Whole content of a small file, NULL otherwise
+    uint64_t size;                  // Bytes in data, or size of the file behind fd
+    int fd;                         // Large file left open for the kernel copy, -1 otherwise
+};
+
+/* The walked tree: directories always precede their content, a directory's files precede its subdirectories */
+struct import_list {
+    struct import_entry* entries;
+    size_t count, capacity;
+    size_t* files;                  // Entry indices of the regular files, in walk order
+    size_t file_count, file_capacity;
+    int skipped;                    // Host entries left out by the walk
+};
+
+/* Hand-off between the workers and the metadata writer */
+struct import_pool {
+    struct import_list* list;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;           // A worker finished a file
+    pthread_cond_t room;            // The writer consumed files, or the pool stops
+    size_t next;                    // Next file ordinal a worker claims
+    size_t written;                 // Files the writer has consumed
+    bool stop;
+};
+
+/* ---------------- Host walk ---------------- */
+
+static char* join_path(const char* dir, const char* name) {
+    const size_t len = strlen(dir) + strlen(name) + 2;
+    char* path = malloc(len);
+    if (path) snprintf(path, len, "%s/%s", dir, name);
+    return path;
+}
+
+// Appends an entry taking ownership of host_path; its index, or -1 without memory (host_path freed)
+static int push_entry(struct import_list* list, char* host_path, const int parent, const char* name, const bool is_directory) {
+    if (list->count == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        struct import_entry* grown = realloc(list->entries, capacity * sizeof(*grown));
+        if (!grown) { free(host_path); return -1; }
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    if (!is_directory && list->file_count == list->file_capacity) {
+        const size_t capacity = list->file_capacity ? list->file_capacity * 2 : 256;
+        size_t* grown = realloc(list->files, capacity * sizeof(*grown));
+        if (!grown) { free(host_path); return -1; }
+        list->files = grown;
+        list->file_capacity = capacity;
+    }
+
+    struct import_entry* e = &list->entries[list->count];
+    memset(e, 0, sizeof(*e));
+    e->host_path = host_path;
+    e->parent = parent;
+    memcpy(e->name, name, strlen(name) + 1); // Callers pass names shorter than MAX_FILENAME_LEN
+    e->is_directory = is_directory;
+    e->inode_id = -1;
+    e->fd = -1;
+
+    if (!is_directory) list->files[list->file_count++] = list->count;
+    return (int)list->count++;
+}
+
+// Adds the content of an open host directory below entry dir_index and closes it; false only without memory
+static bool walk_host(struct import_list* list, DIR* dir, const int dir_index) {
+    const char* dir_path = list->entries[dir_index].host_path;
+    char** subdirs = NULL;
+    size_t nsub = 0, cap = 0;
+    bool ok = true;
+
+    struct dirent* de;
+    while (ok && (de = readdir(dir)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+
+        char* path = join_path(dir_path, de->d_name);
+        if (!path) { ok = false; break; }
+
+        // Symlinks and special files have no VFS counterpart
+        struct stat st;
+        if (lstat(path, &st) != 0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode)) || strlen(de->d_name) >= MAX_FILENAME_LEN) {
+            printf("SKIPPED %s\n", path);
+            list->skipped++;
+            free(path);
+            continue;
+        }
+
+        if (S_ISREG(st.st_mode)) {
+            ok = push_entry(list, path, dir_index, de->d_name, false) >= 0;
+            continue;
+        }
+
+        // Subdirectories go after all files so each directory is filled in one go
+        if (nsub == cap) {
+            cap = cap ? cap * 2 : 16;
+            char** grown = realloc(subdirs, cap * sizeof(*grown));
+            if (!grown) { free(path); ok = false; break; }
+            subdirs = grown;
+        }
+        subdirs[nsub++] = path;
+    }
+    closedir(dir);
+
+    for (size_t i = 0; i < nsub; i++) {
+        if (!ok) { free(subdirs[i]); continue; }
+
+        const int index = push_entry(list, subdirs[i], dir_index, strrchr(subdirs[i], '/') + 1, true);
+        if (index < 0) { ok = false; continue; }
+
+        // An unreadable directory is still created, just empty
+        DIR* sub = opendir(list->entries[index].host_path);
+        if (!sub) {
+            printf("CANNOT READ %s\n", list->entries[index].host_path);
+            list->skipped++;
+            continue;
+        }
+        ok = walk_host(list, sub, index);
+    }
+    free(subdirs);
+    return ok;
+}
+
+static void release_entry(struct import_entry* e) {
+    free(e->data);
+    e->data = NULL;
+    if (e->fd >= 0) close(e->fd);
+    e->fd = -1;
+}
+
+static void free_list(struct import_list* list) {
+    for (size_t i = 0; i < list->count; i++) {
+        release_entry(&list->entries[i]);
+        free(list->entries[i].host_path);
+    }
+    free(list->entries);
+    free(list->files);
+}
+
+/* ---------------- Workers ---------------- */
+
+// Opens a host file and reads it whole, or leaves it open for the kernel copy when it is large
+static void load_file(struct import_entry* e) {
+    e->fd = open(e->host_path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (e->fd < 0 || fstat(e->fd, &st) != 0) {
+        e->error = errno;
+        return;
+    }
+
+    e->size = (uint64_t)st.st_size;
+    if (e->size > TREE_COPY_BUFFER_LIMIT) return;
+
+    e->data = malloc(e->size ? e->size : 1);
+    if (!e->data) {
+        e->error = ENOMEM;
+        return;
+    }
+
+    uint64_t done = 0;
+    while (done < e->size) {
+        const ssize_t n = pread(e->fd, e->data + done, e->size - done, (off_t)done);
+        if (n < 0) { e->error = errno; break; }
+        if (n == 0) break; // Shrank since fstat: keep what is there
+        done += (uint64_t)n;
+    }
+    e->size = done;
+
+    close(e->fd);
+    e->fd = -1;
+}
+
+static void* import_worker(void* arg) {
+    struct import_pool* pool = arg;
+    const struct import_list* list = pool->list;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        // Stay at most TREE_COPY_READ_AHEAD files ahead of the writer
+        while (!pool->stop && pool->next < list->file_count && pool->next >= pool->written + TREE_COPY_READ_AHEAD) {
+            pthread_cond_wait(&pool->room, &pool->lock);
+        }
+        if (pool->stop || pool->next >= list->file_count) break;
+
+        struct import_entry* e = &list->entries[list->files[pool->next++]];
+        pthread_mutex_unlock(&pool->lock);
+
+        load_file(e);
+
+        pthread_mutex_lock(&pool->lock);
+        e->ready = true;
+        pthread_cond_signal(&pool->ready);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Writer side: releases the first `done` files to the workers, waits for the next one and returns how many in a row are loaded
+static size_t wait_batch(struct import_pool* pool, const size_t done) {
+    const struct import_list* list = pool->list;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->written = done;
+    pthread_cond_broadcast(&pool->room);
+
+    while (!list->entries[list->files[done]].ready) pthread_cond_wait(&pool->ready, &pool->lock);
+
+    size_t n = 1;
+    while (done + n < list->file_count && list->entries[list->files[done + n]].ready) n++;
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
+
+/* ---------------- Metadata writer ---------------- */
+
+// Creates the VFS file and fills it from the worker's buffer or descriptor
+static bool store_file(const struct import_entry* e, const int dir_inode) {
+    if (e->size > max_file_size()) return false;
+
+    const int inode_id = create_at(dir_inode, e->name, false);
+    if (inode_id < 0) return false;
+
+    struct file_handle* fh = file_open(inode_id);
+    bool ok = fh != NULL;
+    if (ok && e->data) ok = e->size == 0 || file_pwrite(fh, e->data, e->size, 0) == (int64_t)e->size;
+    else if (ok) ok = fs_import_fd(fh, e->fd, e->size);
+    if (!file_close(fh)) ok = false;
+
+    // Do not leave a partial file behind
+    if (!ok) unlink_at(dir_inode, e->name, false);
+    return ok;
+}
+
+int tree_import(const char* host_dir, const int parent_inode, const char* name) {
+    DIR* dir = opendir(host_dir);
+    if (!dir) return 1;
+
+    struct import_list list = {0};
+    char* root_path = strdup(host_dir);
+    if (!root_path || push_entry(&list, root_path, -1, name, true) < 0) {
+        closedir(dir);
+        free_list(&list);
+        printf("MEMORY ERROR\n");
+        return 1;
+    }
+    if (!walk_host(&list, dir, 0)) {
+        free_list(&list);
+        printf("MEMORY ERROR\n");
+        return 1;
+    }
+
+    list.entries[0].inode_id = create_at(parent_inode, name, true);
+    if (list.entries[0].inode_id < 0) {
+        free_list(&list);
+        return 2;
+    }
+
+    struct import_pool pool = { .list = &list };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.ready, NULL);
+    pthread_cond_init(&pool.room, NULL);
+
+    pthread_t threads[TREE_COPY_WORKERS];
+    int workers = 0;
+    while (workers < TREE_COPY_WORKERS && (size_t)workers < list.file_count &&
+           pthread_create(&threads[workers], NULL, import_worker, &pool) == 0) {
+        workers++;
+    }
+
+    // Entries are applied in walk order, so a directory exists before anything inside it
+    int failed = list.skipped;
+    size_t file = 0, batch = 0;
+    for (size_t i = 1; i < list.count; i++) {
+        struct import_entry* e = &list.entries[i];
+        const int dir_inode = list.entries[e->parent].inode_id;
+
+        if (e->is_directory) {
+            e->inode_id = dir_inode < 0 ? -1 : create_at(dir_inode, e->name, true);
+            if (e->inode_id < 0) {
+                printf("CANNOT CREATE %s\n", e->host_path);
+                failed++;
+            }
+            continue;
+        }
+
+        // No worker could be started: load on this thread instead
+        if (workers == 0) load_file(e);
+        else if (batch == 0) batch = wait_batch(&pool, file);
+        if (batch > 0) batch--;
+        file++;
+
+        if (dir_inode < 0) {
+            failed++; // Parent already reported
+        } else if (e->error) {
+            printf("CANNOT READ %s: %s\n", e->host_path, strerror(e->error));
+            failed++;
+        } else if (!store_file(e, dir_inode)) {
+            printf("WRITE FAILED %s\n", e->host_path);
+            failed++;
+        }
+        release_entry(e);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.room);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&pool.room);
+    pthread_cond_destroy(&pool.ready);
+    pthread_mutex_destroy(&pool.lock);
+    free_list(&list);
+
+    return failed ? 3 : 0;
+}
+
+/* ---------------- Export ---------------- */
+
+/* File blocks [logical, logical + length) stored from data block start */
+struct export_run {
+    uint32_t logical, start, length;
+};
+
+/* One VFS file to recreate on the host */
+struct export_file {
+    char* host_path;                // Host path (owned)
+    uint64_t size;                  // File size
+};
+
+/* Unit of work: consecutive runs of one file, at most TREE_COPY_JOB_BLOCKS blocks */
+struct export_job {
+    size_t file;                    // Index in export_plan.files
+    size_t first_run, run_count;    // Slice of export_plan.runs
+    bool failed;                    // Set by the worker that ran the job
+};
+
+/* Everything the workers need, resolved by the calling thread before they start */
+struct export_plan {
+    struct export_file* files;
+    size_t file_count, file_capacity;
+    struct export_run* runs;
+    size_t run_count, run_capacity;
+    struct export_job* jobs;
+    size_t job_count, job_capacity;
+    uint32_t job_blocks;            // Blocks in the last job, while its file is planned
+    int failed;                     // Directories that could not be created
+    bool ok;                        // Cleared when memory runs out
+};
+
+/* Entries of one VFS directory, gathered before any of them is visited */
+struct export_children {
+    struct export_child {
+        char name[MAX_FILENAME_LEN + 1];
+        int inode_id;
+    }* items;
+    size_t count, capacity;
+    bool ok;
+};
+
+/* Hand-out of jobs to the workers */
+struct export_pool {
+    struct export_plan* plan;
+    pthread_mutex_t lock;
+    size_t next;                    // Next job to run
+};
+
+// Room for one more element of size bytes; the (possibly moved) array, or NULL with the old one left intact
+static void* reserve(void* array, size_t* capacity, const size_t count, const size_t size) {
+    if (count < *capacity) return array;
+
+    const size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+    void* grown = realloc(array, grown_capacity * size);
+    if (grown) *capacity = grown_capacity;
+    return grown;
+}
+
+static bool start_job(struct export_plan* plan, const size_t file) {
+    struct export_job* jobs = reserve(plan->jobs, &plan->job_capacity, plan->job_count, sizeof(*jobs));
+    if (!jobs) return false;
+    plan->jobs = jobs;
+
+    jobs[plan->job_count++] = (struct export_job){ .file = file, .first_run = plan->run_count };
+    plan->job_blocks = 0;
+    return true;
+}
+
+// for_each_directory_item() visitor
+static void collect_child(void* ctx, const char* name, const int inode_id) {
+    struct export_children* children = ctx;
+    struct export_child* items = reserve(children->items, &children->capacity, children->count, sizeof(*items));
+    if (!items) {
+        children->ok = false;
+        return;
+    }
+    children->items = items;
+
+    struct export_child* child = &items[children->count++];
+    snprintf(child->name, sizeof(child->name), "%s", name);
+    child->inode_id = inode_id;
+}
+
+// block_map_walk() visitor: appends the runs of the file being planned, starting a new job every TREE_COPY_JOB_BLOCKS
+static void collect_run(void* ctx, uint32_t logical, uint32_t start, uint32_t length) {
+    struct export_plan* plan = ctx;
+
+    while (plan->ok && length > 0) {
+        if (plan->job_blocks == TREE_COPY_JOB_BLOCKS && !start_job(plan, plan->file_count - 1)) {
+            plan->ok = false;
+            return;
+        }
+
+        struct export_run* runs = reserve(plan->runs, &plan->run_capacity, plan->run_count, sizeof(*runs));
+        if (!runs) {
+            plan->ok = false;
+            return;
+        }
+        plan->runs = runs;
+
+        const uint32_t take = length < TREE_COPY_JOB_BLOCKS - plan->job_blocks ? length : TREE_COPY_JOB_BLOCKS - plan->job_blocks;
+        runs[plan->run_count++] = (struct export_run){ logical, start, take };
+        plan->jobs[plan->job_count - 1].run_count++;
+        plan->job_blocks += take;
+
+        logical += take;
+        start += take;
+        length -= take;
+    }
+}
+
+// Plans one file, taking ownership of host_path
+static bool add_file(struct export_plan* plan, char* host_path, const struct pseudo_inode* inode) {
+    struct export_file* files = reserve(plan->files, &plan->file_capacity, plan->file_count, sizeof(*files));
+    if (!files) {
+        free(host_path);
+        return false;
+    }
+    plan->files = files;
+    files[plan->file_count++] = (struct export_file){ host_path, inode->file_size };
+
+    // Every file gets a job, even without blocks: the worker creates it
+    if (!start_job(plan, plan->file_count - 1)) return false;
+    block_map_walk(inode, collect_run, plan);
+    return plan->ok;
+}
+
+// Creates the host side of a VFS directory's subtree and plans its files; false only without memory
+static bool walk_vfs(struct export_plan* plan, const int dir_inode, const char* host_dir) {
+    struct export_children children = { .ok = true };
+    for_each_directory_item(dir_inode, collect_child, &children);
+
+    bool ok = children.ok;
+    for (size_t i = 0; ok && i < children.count; i++) {
+        char* path = join_path(host_dir, children.items[i].name);
+        if (!path) { ok = false; break; }
+
+        struct pseudo_inode inode;
+        if (!read_inode(children.items[i].inode_id, &inode)) {
+            printf("CANNOT READ %s\n", path);
+            plan->failed++;
+            free(path);
+        } else if (!inode.is_directory) {
+            ok = add_file(plan, path, &inode);
+        } else if (mkdir(path, 0777) != 0) {
+            printf("CANNOT CREATE %s: %s\n", path, strerror(errno));
+            plan->failed++;
+            free(path);
+        } else {
+            ok = walk_vfs(plan, children.items[i].inode_id, path);
+            free(path);
+        }
+    }
+
+    free(children.items);
+    return ok;
+}
+
+static void free_plan(struct export_plan* plan) {
+    for (size_t i = 0; i < plan->file_count; i++) free(plan->files[i].host_path);
+    free(plan->files);
+    free(plan->runs);
+    free(plan->jobs);
+}
+
+// Worker side: writes the job's runs into the host file, creating and sizing it
+static bool run_job(const struct export_plan* plan, const struct export_job* job) {
+    const struct export_file* file = &plan->files[job->file];
+    const int fd = open(file->host_path, O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+
+    // Every job of a file sets the same size: holes read as zeros and no job cuts another's data
+    bool ok = ftruncate(fd, (off_t)file->size) == 0;
+    for (size_t r = 0; ok && r < job->run_count; r++) {
+        const struct export_run* run = &plan->runs[job->first_run + r];
+        const uint64_t offset = (uint64_t)run->logical * BLOCK_SIZE;
+        if (offset >= file->size) break;
+
+        uint64_t bytes = (uint64_t)run->length * BLOCK_SIZE;
+        if (bytes > file->size - offset) bytes = file->size - offset;
+        ok = copy_blocks_to_fd_direct((int)run->start, bytes, fd, offset);
+    }
+
+    if (close(fd) != 0) ok = false;
+    return ok;
+}
+
+static void* export_worker(void* arg) {
+    struct export_pool* pool = arg;
+    struct export_plan* plan = pool->plan;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        const size_t j = pool->next < plan->job_count ? pool->next++ : plan->job_count;
+        pthread_mutex_unlock(&pool->lock);
+        if (j == plan->job_count) return NULL;
+
+        plan->jobs[j].failed = !run_job(plan, &plan->jobs[j]);
+    }
+}
+
+int tree_export(const int dir_inode, const char* host_dir) {
+    if (mkdir(host_dir, 0777) != 0) return 2;
+
+    struct export_plan plan = { .ok = true };
+    if (!walk_vfs(&plan, dir_inode, host_dir)) {
+        free_plan(&plan);
+        printf("MEMORY ERROR\n");
+        return 3;
+    }
+
+    // Workers read the container file directly: cached blocks must be in it first
+    fs_sync();
+
+    struct export_pool pool = { .plan = &plan };
+    pthread_mutex_init(&pool.lock, NULL);
+
+    // The calling thread is the last worker
+    pthread_t threads[TREE_COPY_WORKERS - 1];
+    int workers = 0;
+    while (workers < TREE_COPY_WORKERS - 1 && (size_t)workers + 1 < plan.job_count &&
+           pthread_create(&threads[workers], NULL, export_worker, &pool) == 0) {
+        workers++;
+    }
+    export_worker(&pool);
+    for (int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&pool.lock);
+
+    // Jobs of a file are consecutive: report each file once
+    int failed = plan.failed;
+    size_t reported = plan.file_count;
+    for (size_t j = 0; j < plan.job_count; j++) {
+        if (!plan.jobs[j].failed || plan.jobs[j].file == reported) continue;
+        reported = plan.jobs[j].file;
+        printf("WRITE FAILED %s\n", plan.files[reported].host_path);
+        failed++;
+    }
+
+    free_plan(&plan);
+    return failed ? 3 : 0;
+}
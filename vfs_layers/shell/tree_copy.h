@@ -0,0 +1,60 @@
+#ifndef TREE_COPY_H
+#define TREE_COPY_H
+
+#include "../logic/logic_layer.h"
+
+/**
+ * @file tree_copy.h
+ * @brief Recursive copies of whole directory trees between the host and the VFS.
+ *
+ * Host I/O is spread over a pool of worker threads; every VFS metadata
+ * change (inode and block allocation, directory inserts) stays on the
+ * calling thread, which applies them in walk order.
+ */
+
+/** @brief Worker threads doing host I/O; they mostly block on the host, so this is not tied to the CPU count. */
+#define TREE_COPY_WORKERS 4
+
+/** @brief Files read ahead of the metadata writer; with TREE_COPY_BUFFER_LIMIT this bounds memory. */
+#define TREE_COPY_READ_AHEAD 64
+
+/** @brief Host files up to this size are read into memory by a worker; larger ones are copied by the kernel. */
+#define TREE_COPY_BUFFER_LIMIT (64 * BLOCK_SIZE)
+
+/** @brief Blocks per export job; larger files are split so several workers copy them at once. */
+#define TREE_COPY_JOB_BLOCKS 2048
+
+/**
+ * @brief Imports a host directory tree as a new VFS directory.
+ *
+ * The host tree is walked first (symlinks, devices and names longer than
+ * MAX_FILENAME_LEN - 1 are skipped and reported). Workers then open and
+ * read the files while the calling thread creates directories and files
+ * in walk order, taking whatever the workers finished in one batch.
+ *
+ * @param host_dir Host directory to copy.
+ * @param parent_inode VFS directory receiving the copy.
+ * @param name Name of the new directory; must not exist in parent_inode.
+ * @return 0 on success, 1 if host_dir cannot be read, 2 if the directory
+ *         cannot be created, 3 if some entries were skipped or failed.
+ */
+int tree_import(const char* host_dir, int parent_inode, const char* name);
+
+/**
+ * @brief Exports a VFS directory tree to a new host directory.
+ *
+ * The calling thread walks the tree with for_each_directory_item(),
+ * creates the host directories and resolves every file's block runs.
+ * After fs_sync() the runs are copied by the kernel straight from the
+ * container, on TREE_COPY_WORKERS threads (the calling one included);
+ * files larger than TREE_COPY_JOB_BLOCKS are split between workers.
+ * Holes stay holes on the host.
+ *
+ * @param dir_inode VFS directory to copy.
+ * @param host_dir Host directory to create; its parent must exist, it must not.
+ * @return 0 on success, 2 if host_dir cannot be created, 3 if some
+ *         entries could not be copied.
+ */
+int tree_export(int dir_inode, const char* host_dir);
+
+#endif // TREE_COPY_H